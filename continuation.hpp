@@ -4,6 +4,9 @@
 #include "details/continuation_meta.hpp"
 #include "details/continuation_details.hpp"
 #include "details/switch_base.hpp"
+#ifdef GPD_SHARED_STACK
+#include "details/shared_stack.hpp"
+#endif
 #include "forwarding.hpp"
 #include "tuple.hpp"
 #include <exception>
@@ -133,8 +136,9 @@ struct continuation<Result(Args...)> {
     continuation& operator() (Args... args) {
         assert(!empty());
         switch_pair cpair = pilfer();
-        std::tuple<Args...> p(std::forward<Args>(args)...);
-        auto new_pair = stack_switch_impl(cpair.sp, &p);
+        auto new_pair = details::send<Args...>
+            (typename details::arg_transfer<Args...>::type(), cpair.sp,
+             std::forward<Args>(args)...);
         assert(empty());
         pair = new_pair;
                 
@@ -155,7 +159,8 @@ struct continuation<Result(Args...)> {
     /** 
      * Returns true if !empty() && has_data.
      *
-     * NOTE that has_data is always true if result_type is void
+     * NOTE that has_data is always true if result_type is void, unless
+     * cancelled()
      */  
     explicit operator bool() const {
         return !empty() && has_data();
@@ -163,12 +168,21 @@ struct continuation<Result(Args...)> {
 
     /**
      * Returns true if there is data retrivable via get(). If
-     * result_type is void, always returns true.
+     * result_type is void, always returns true unless cancelled().
      */ 
     bool has_data() const {
         return has_data(details::tag<result_type>(), pair.parm);
     }
 
+    /**
+     * Returns true if the other end has requested, via cancel(), that
+     * this context finishes. The context should unwind and return this
+     * continuation from its functor.
+     */
+    bool cancelled() const {
+        return pair.parm == details::cancel_request();
+    }
+
     /**
      * Returns true if this continuation is not associated with an
      * halted execution context.
@@ -220,24 +234,30 @@ private:
 
     template<class T> 
     static bool has_data(details::tag<T>, void * parm)  {
-        return parm;
+        return parm && parm != details::cancel_request();
     }
 
-    static bool has_data(details::tag<void>, void*)  {
-        return true;
+    static bool has_data(details::tag<void>, void * parm)  {
+        return parm != details::cancel_request();
     }
 
     template<class T> 
     static result_type get(details::tag<T>, void * parm)  {
-        typedef std::tuple<T> tuple;
-        return std::move(std::get<0>(static_cast<tuple&>(*static_cast<tuple*>(parm))));
+        return get(typename details::arg_transfer<T>::type(), parm);
     }
 
+    static result_type get(details::register_transfer, void * parm)  {
+        return details::unpack_register<result_type>(parm);
+    }
+
+    static result_type get(details::pointer_transfer, void * parm)  {
+        typedef typename std::remove_reference<result_type>::type T;
+        return std::move(*static_cast<T*>(parm));
+    }
 
     template<class T> 
     static result_type get(details::tag<T&>, void * parm)  {
-        typedef std::tuple<T&> tuple;
-        return std::get<0>(static_cast<tuple&>(*static_cast<tuple*>(parm)));
+        return *static_cast<T*>(parm);
     }
         
     template<class... T> 
@@ -294,6 +314,124 @@ auto callcc(continuation<IntoSignature> c, F f, Args&&... args) as
      (std::move(c), gpd::bind(std::move(f), gpd::placeholder<0>(), 
                               std::forward<Args>(args)...)));
 
+/**
+ * Same as the two overloads above, but the stack of the new
+ * continuation is 'size' bytes instead of the allocator default.
+ */
+template<class F, 
+         class... Args,
+         class Sig = typename details::deduce_signature<F>::type>
+continuation<Sig> callcc(stack_size_t size, F f, Args&&... args) {
+    return details::create_continuation<Sig> 
+        (gpd::bind(std::move(f), placeholder<0>(), 
+                   std::forward<Args>(args)...),
+         default_stack_allocator(), size.size); 
+}
+
+template<class Sig, 
+         class F, 
+         class... Args>
+continuation<Sig> callcc(stack_size_t size, F f,  Args&&... args) {
+    return details::create_continuation<Sig>
+        (gpd::bind(std::move(f), placeholder<0>(), 
+                   std::forward<Args>(args)...),
+         default_stack_allocator(), size.size);
+}
+
+/**
+ * Same as the callcc(f, args...) overloads, but the stack of the new
+ * continuation is allocated with 'alloc', e.g. an
+ * instrumented_stack_allocator with a call-site specific tag.
+ */
+template<class StackAlloc,
+         class F, 
+         class... Args,
+         class Sig = typename details::deduce_signature<F>::type>
+continuation<Sig> callcc(std::allocator_arg_t, StackAlloc alloc, F f, Args&&... args) {
+    return details::create_continuation<Sig> 
+        (gpd::bind(std::move(f), placeholder<0>(), 
+                   std::forward<Args>(args)...),
+         std::move(alloc)); 
+}
+
+template<class Sig, 
+         class StackAlloc,
+         class F, 
+         class... Args>
+continuation<Sig> callcc(std::allocator_arg_t, StackAlloc alloc, F f, Args&&... args) {
+    return details::create_continuation<Sig>
+        (gpd::bind(std::move(f), placeholder<0>(), 
+                   std::forward<Args>(args)...),
+         std::move(alloc));
+}
+
+/**
+ * Tag to request a deferred-start continuation: the functor is stored
+ * on the new stack, but, unlike the other callcc overloads, it is
+ * not run until the first time the returned continuation is resumed,
+ * or, if it is interrupted via callcc(c, f), until f returns. The
+ * arguments of the first resume are available to the functor via
+ * get() on its continuation parameter. Creating a deferred
+ * continuation does not switch stacks.
+ *
+ * NOTE: exceptions thrown by a function executed via callcc(c, f)
+ * on top of a never started continuation can't be propagated and
+ * terminate the program. Destroying it is fine.
+ */
+constexpr struct deferred_start_tag {} deferred_start = {};
+
+template<class F, 
+         class... Args,
+         class Sig = typename details::deduce_signature<F>::type>
+continuation<Sig> callcc(deferred_start_tag, F f, Args&&... args) {
+    return details::create_deferred_continuation<Sig> 
+        (gpd::bind(std::move(f), placeholder<0>(), 
+                   std::forward<Args>(args)...)); 
+}
+
+template<class Sig, 
+         class F, 
+         class... Args>
+continuation<Sig> callcc(deferred_start_tag, F f,  Args&&... args) {
+    return details::create_deferred_continuation<Sig>
+        (gpd::bind(std::move(f), placeholder<0>(), 
+                   std::forward<Args>(args)...));
+}
+
+#ifdef GPD_SHARED_STACK
+/**
+ * Tag to request a copy-on-park shared-stack continuation; see
+ * details/shared_stack.hpp for the trade offs and restrictions.
+ */
+constexpr struct shared_stack_tag {} shared_stack = {};
+
+template<class F, 
+         class... Args,
+         class Sig = typename details::deduce_signature<F>::type>
+continuation<Sig> callcc(shared_stack_tag, F f, Args&&... args) {
+    typedef decltype(gpd::bind(std::move(f), placeholder<0>(), 
+                               std::forward<Args>(args)...)) bound;
+    return details::create_continuation<Sig> 
+        (details::shared_entry<bound>{
+            gpd::bind(std::move(f), placeholder<0>(), 
+                      std::forward<Args>(args)...)},
+         details::shared_stack_allocator()); 
+}
+
+template<class Sig, 
+         class F, 
+         class... Args>
+continuation<Sig> callcc(shared_stack_tag, F f,  Args&&... args) {
+    typedef decltype(gpd::bind(std::move(f), placeholder<0>(), 
+                               std::forward<Args>(args)...)) bound;
+    return details::create_continuation<Sig> 
+        (details::shared_entry<bound>{
+            gpd::bind(std::move(f), placeholder<0>(), 
+                      std::forward<Args>(args)...)},
+         details::shared_stack_allocator()); 
+}
+#endif
+
 /**
  * The following four oerloads are not strictly necessary but may
  * speedup compilation by skipping the argument packing via bind.
@@ -357,11 +495,54 @@ void exit_to(continuation<Signature> c) {
  
 template<class Signature>
 void signal_exit(continuation<Signature>& c) {
+    assert(!c.cancelled() && "a cancelled continuation must be returned");
+    if (unstarted_context(details::switch_pair_accessor::get(c).sp)) {
+        auto r = stack_switch(details::switch_pair_accessor::pilfer(c).sp,
+                              details::deferred_cancel());
+        assert(!r.sp.sp); (void)r;
+        return;
+    }
     callcc(std::move(c), [] (continuation<void()> c) { 
             exit_to(std::move(c));
         });
 }
 
+/**
+ * Finish the context of 'c' without throwing on its stack, if it
+ * cooperates.
+ *
+ * The context is resumed with a cancellation request: the switch it
+ * is halted in returns with a continuation that is cancelled(), with
+ * no data and which converts to false, so loops like
+ * 'while (c) c(x);' or range for over a generator terminate. The
+ * context is expected to unwind normally and return that
+ * continuation from its functor; the stack is then released and
+ * cancel() returns, with no exception thrown. Cooperative teardown is
+ * much cheaper than the forced exit of ~continuation, which unwinds
+ * the stack via exit_exception.
+ *
+ * If instead the context switches to the cancelled continuation, it
+ * is forced to exit with signal_exit. Contexts which have never been
+ * started are destroyed without running their functor.
+ *
+ * Precondition: !c.empty()
+ */
+template<class Signature>
+void cancel(continuation<Signature> c) {
+    assert(!c.empty());
+    if (unstarted_context(details::switch_pair_accessor::get(c).sp)) {
+        signal_exit(c);
+        return;
+    }
+    switch_pair r = stack_switch(details::switch_pair_accessor::pilfer(c).sp,
+                                 details::cancel_request());
+    if (r.sp.sp) {
+        // the context did not cooperate
+        continuation<void()> rest(r);
+        signal_exit(rest);
+    }
+}
+
 template<class Continuation>
 struct output_iterator_adaptor  {
     typedef std::output_iterator_tag iterator_category;
@@ -1,18 +1,18 @@
 #ifndef GPD_CV_WAITER_HPP
 #define GPD_CV_WAITER_HPP
 #include "event.hpp"
+#include "details/deadline.hpp"
 #include <thread>
 #include <iostream>
 namespace gpd {
-struct cv_waiter : waiter {
+struct cv_waiter : direct_waiter<cv_waiter> {
     std::int32_t signal_counter = 0;
     std::mutex mux;
     std::condition_variable cvar;
 
     void reset() { signal_counter = 0; }
     
-    void signal(event_ptr p) override {
-        p.release();
+    void on_signal(event_base *) {
         bool signal = false;
         {   std::unique_lock<std::mutex>_ (mux);
 
@@ -23,6 +23,19 @@ struct cv_waiter : waiter {
             cvar.notify_one();
     }
 
+    void signal_many(event_ptr * ps, std::size_t n) override {
+        for (std::size_t i = 0; i < n; ++i)
+            ps[i].release();
+        bool signal = false;
+        {   std::unique_lock<std::mutex>_ (mux);
+            auto old = signal_counter;
+            signal_counter -= n;
+            signal = old > 0 && signal_counter <= 0;
+        }
+        if (signal)
+            cvar.notify_one();
+    }
+
     void wait(std::uint32_t count = 1)   {
         std::unique_lock<std::mutex> lock (mux);
         signal_counter += count;
@@ -31,6 +44,21 @@ struct cv_waiter : waiter {
         }
     }
 
+    /// As wait, but give up at 'deadline': the count is restored and
+    /// false returned.
+    bool wait_until(std::uint32_t count, deadline_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock (mux);
+        signal_counter += count;
+        while(signal_counter > 0) {
+            if (cvar.wait_until(lock, deadline) == std::cv_status::timeout &&
+                signal_counter > 0) {
+                signal_counter -= count;
+                return false;
+            }
+        }
+        return true;
+    }
+
 
 };
 }
@@ -4,7 +4,13 @@
 #include "continuation_exception.hpp"
 #include "stack_allocator.hpp"
 #include "guard.hpp"
+#include "fiber_storage.hpp"
 #include <utility>
+#include <new>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
 namespace gpd {
 
 template<class Signature>
@@ -12,6 +18,71 @@ struct continuation;
 
 namespace details {
 
+/**
+ * How the arguments sent by a switch are transferred.
+ *
+ * - register_transfer: a single small trivially copyable argument is
+ *   packed into the switch parameter itself, as (bits << 8 | 1), so
+ *   that it is never zero (i.e. no data);
+ * - pointer_transfer: for any other single argument, the parameter
+ *   points to the argument itself (to the referred object for
+ *   references);
+ * - tuple_transfer: the parameter points to a tuple of all the
+ *   arguments.
+ *
+ * Sender and receiver must agree: a single argument of type T is
+ * received as result type T.
+ */
+struct register_transfer {};
+struct pointer_transfer {};
+struct tuple_transfer {};
+
+template<class... Args>
+struct arg_transfer { typedef tuple_transfer type; };
+
+template<class T>
+struct arg_transfer<T> {
+    typedef typename std::conditional<
+        !std::is_reference<T>::value &&
+        std::is_trivially_copyable<T>::value &&
+        sizeof(T) <= 4,
+        register_transfer, pointer_transfer>::type type;
+};
+
+// Values sent in a register have the low bit set, so they never
+// compare equal to the (aligned) markers deferred_cancel and
+// cancel_request.
+template<class T>
+parm_t pack_register(const T& x) {
+    std::uintptr_t bits = 0;
+    std::memcpy(&bits, &x, sizeof(T));
+    return reinterpret_cast<parm_t>(bits << 8 | 1);
+}
+
+template<class T>
+T unpack_register(parm_t parm) {
+    std::uintptr_t bits = reinterpret_cast<std::uintptr_t>(parm) >> 8;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type x;
+    std::memcpy(&x, &bits, sizeof(T));
+    return reinterpret_cast<T&>(x);
+}
+
+template<class... Args>
+switch_pair send(tuple_transfer, cont sp, Args&&... args) {
+    std::tuple<Args...> p(std::forward<Args>(args)...);
+    return stack_switch(sp, &p);
+}
+
+template<class T>
+switch_pair send(register_transfer, cont sp, T&& x) {
+    return stack_switch(sp, pack_register(x));
+}
+
+template<class T>
+switch_pair send(pointer_transfer, cont sp, T&& x) {
+    return stack_switch(sp, const_cast<void*>(static_cast<const volatile void*>(std::addressof(x))));
+}
+
 template<class StackAlloc>
 struct cleanup_trampoline_args {
     StackAlloc allocator; 
@@ -65,13 +136,16 @@ auto do_call(F& f, Continuation c) ->
 }
 
 template<class Continuation, class F, class StackAlloc>
-switch_pair startup_trampoline(parm_t arg, cont sp) {
-    auto argsp = static_cast<startup_trampoline_args<F, StackAlloc>*>(arg);
+switch_pair run_startup(startup_trampoline_args<F, StackAlloc> * argsp,
+                        switch_pair pair, bool destroy_args) {
     cleanup_trampoline_args<StackAlloc> cleanup_args
     { std::move(argsp->allocator), argsp->stackp, 0 };
+    cont sp;
     try {
+        fiber_storage_scope fls;
         auto f(std::move(argsp->functor)); 
-        switch_pair pair = {sp,0};
+        if (destroy_args)
+            argsp->~startup_trampoline_args<F, StackAlloc>();
         sp = do_call(f, Continuation(pair)).sp;
     } catch(abnormal_exit_exception& e) {
         sp = details::switch_pair_accessor::pilfer(e).sp;
@@ -83,6 +157,45 @@ switch_pair startup_trampoline(parm_t arg, cont sp) {
     return execute_into(&cleanup_args, sp, &cleanup_trampoline<StackAlloc>); 
 }
 
+template<class Continuation, class F, class StackAlloc>
+switch_pair startup_trampoline(parm_t arg, cont sp) {
+    auto argsp = static_cast<startup_trampoline_args<F, StackAlloc>*>(arg);
+    return run_startup<Continuation>(argsp, switch_pair{sp, 0}, false);
+}
+
+// Sent to a deferred continuation that has never been started to
+// destroy it without running its functor. Aligned, so that it can't
+// be mistaken for a value sent in a register (see pack_register).
+inline parm_t deferred_cancel() {
+    static long cancel;
+    return &cancel;
+}
+
+// Sent by cancel() to ask a context to finish. Aligned, as
+// deferred_cancel.
+inline parm_t cancel_request() {
+    static long request;
+    return &request;
+}
+
+static_assert(alignof(long) > 1,
+              "the cancel markers must differ from register values");
+
+// Started on the first resume of a deferred continuation. The
+// arguments live at the top of the new stack and are destroyed
+// here. The parameter of the first resume is passed to the functor.
+template<class Continuation, class F, class StackAlloc>
+switch_pair deferred_startup_trampoline(parm_t arg, cont sp, parm_t parm) {
+    auto argsp = static_cast<startup_trampoline_args<F, StackAlloc>*>(arg);
+    if (parm == deferred_cancel()) {
+        cleanup_trampoline_args<StackAlloc> cleanup_args
+        { std::move(argsp->allocator), argsp->stackp, 0 };
+        argsp->~startup_trampoline_args<F, StackAlloc>();
+        return execute_into(&cleanup_args, sp, &cleanup_trampoline<StackAlloc>); 
+    }
+    return run_startup<Continuation>(argsp, switch_pair{sp, parm}, true);
+}
+
 template<class FromSignature, class F>
 switch_pair interrupt_trampoline(parm_t  p, cont from) {
     typedef continuation<FromSignature> from_cont;
@@ -113,6 +226,30 @@ create_continuation(F f, StackAlloc alloc = StackAlloc(),
                                                     F, StackAlloc>));
 }
 
+// Like create_continuation, but the functor is only stored at the
+// top of the new stack, and started at the first resume.
+template<class Signature, 
+         class F,
+         class StackAlloc = default_stack_allocator>
+continuation<Signature> 
+create_deferred_continuation(F f, StackAlloc alloc = StackAlloc(), 
+                             size_t stack_size = StackAlloc::stack_size)  {
+    typedef startup_trampoline_args<F, StackAlloc> args_t;
+    static_assert(alignof(args_t) <= 16, "overaligned functor");
+    void * stackp = alloc.allocate(stack_size);
+    char * top = static_cast<char*>(stackp) + stack_size;
+    void * header = (void*)((std::uintptr_t)(top - sizeof(args_t)) & ~std::uintptr_t(15));
+
+    typedef typename continuation<Signature>::rsignature rsignature;
+
+    new (header) args_t{ std::move(f), std::move(alloc), stackp };
+    return continuation<Signature>
+        (switch_pair{ make_context(header, header, 
+                                   &deferred_startup_trampoline
+                                   <continuation<rsignature>, F, StackAlloc>),
+                      0 });
+}
+
 template<class NewIntoSignature, class IntoSignature, class F>
 continuation<NewIntoSignature> 
 interrupt_continuation(continuation<IntoSignature> c, F f) {
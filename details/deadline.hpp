@@ -0,0 +1,59 @@
+#ifndef GPD_DEADLINE_HPP
+#define GPD_DEADLINE_HPP
+#include <chrono>
+#include <ctime>
+
+namespace gpd {
+
+/// Clock of the timed waits (CLOCK_MONOTONIC).
+using deadline_clock = std::chrono::steady_clock;
+
+namespace details {
+
+/// 'd' as a timespec; negative durations are zero.
+inline timespec to_timespec(deadline_clock::duration d) {
+    using namespace std::chrono;
+    if (d < deadline_clock::duration::zero())
+        d = deadline_clock::duration::zero();
+    auto s = duration_cast<seconds>(d);
+    timespec ts;
+    ts.tv_sec = s.count();
+    ts.tv_nsec = duration_cast<nanoseconds>(d - s).count();
+    return ts;
+}
+
+/// Time left before 'deadline', zero once expired.
+inline timespec time_left(deadline_clock::time_point deadline) {
+    return to_timespec(deadline - deadline_clock::now());
+}
+
+/// 'rel' from now on deadline_clock, saturated on overflow.
+template<class Rep, class Period>
+deadline_clock::time_point
+deadline_after(const std::chrono::duration<Rep, Period>& rel) {
+    using namespace std::chrono;
+    auto now = deadline_clock::now();
+    if (rel <= rel.zero())
+        return now;
+    if (duration<double, Period>(rel) >=
+        duration<double>(deadline_clock::time_point::max() - now))
+        return deadline_clock::time_point::max();
+    auto d = duration_cast<deadline_clock::duration>(rel);
+    if (d < rel)
+        ++d;
+    return now + d;
+}
+
+/// 'deadline' of an arbitrary clock on deadline_clock.
+template<class Clock, class Duration>
+deadline_clock::time_point
+to_deadline(const std::chrono::time_point<Clock, Duration>& deadline) {
+    return deadline_after(deadline - Clock::now());
+}
+
+inline deadline_clock::time_point
+to_deadline(deadline_clock::time_point deadline) { return deadline; }
+
+}
+}
+#endif
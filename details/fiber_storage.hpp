@@ -0,0 +1,165 @@
+#ifndef GPD_FIBER_STORAGE_HPP
+#define GPD_FIBER_STORAGE_HPP
+#include "switch_base.hpp"
+#ifdef GPD_TASK_ACCOUNTING
+#include "task_account.hpp"
+#endif
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+
+/**
+ * Backing store of fiber_local.
+ *
+ * Each context started by callcc, each pooled fiber job and each
+ * stackless task owns a fiber_storage, which lives in its outermost
+ * frame, i.e. at the top of its stack. The running context storage is
+ * reachable via a thread local pointer, which every context saves
+ * before switching out and restores when resumed (see stack_switch),
+ * so it follows the context when it migrates between threads. Code
+ * running outside of any context uses a per thread storage.
+ *
+ * The save and restore are only compiled in, and the storages only
+ * installed, when GPD_FIBER_LOCAL is defined (in all translation
+ * units, libraries included: link libtask_fiber_local instead of
+ * libtask), so that programs which don't use fiber_local do not pay
+ * for it on every switch.
+ *
+ * Each fiber_local object is assigned one of GPD_FIBER_LOCAL_SLOTS
+ * slots for the life of the program.
+ *
+ * With GPD_TASK_ACCOUNTING, the storage also holds the scheduling
+ * counters of its context, see task_accounting.hpp.
+ */
+#ifndef GPD_FIBER_LOCAL_SLOTS
+#define GPD_FIBER_LOCAL_SLOTS 16
+#endif
+
+namespace gpd { namespace details {
+
+struct fiber_storage {
+    enum { slot_count = GPD_FIBER_LOCAL_SLOTS };
+    static_assert(slot_count <= 32, "at most 32 fiber local slots");
+    typedef void deleter_t(void*);
+
+    fiber_storage() {}
+    fiber_storage(const fiber_storage&) = delete;
+    ~fiber_storage() { clear(); }
+
+    bool has(std::size_t i) const { return used & (1u << i); }
+
+    void * get(std::size_t i) const {
+        assert(has(i));
+        return slots[i];
+    }
+
+    void set(std::size_t i, void * p) {
+        assert(!has(i));
+        slots[i] = p;
+        used |= 1u << i;
+    }
+
+    /// Destroy all the values. A destructor may access fiber locals,
+    /// values created meanwhile are destroyed too.
+    void clear() {
+        while (used) {
+            std::size_t i = __builtin_ctz(used);
+            used &= used - 1;
+            deleters()[i](slots[i]);
+        }
+    }
+
+    /// Storage of the running context.
+    static fiber_storage& current() {
+        auto& p = fiber_storage_current();
+        if (__builtin_expect(!p, false)) {
+            static thread_local fiber_storage thread_storage;
+            p = &thread_storage;
+        }
+        return *p;
+    }
+
+    static std::size_t allocate_slot(deleter_t * deleter) {
+        static std::atomic<std::size_t> next = { 0 };
+        std::size_t i = next++;
+        assert(i < slot_count && "too many fiber_local objects, "
+               "raise GPD_FIBER_LOCAL_SLOTS");
+        deleters()[i] = deleter;
+        return i;
+    }
+
+#ifdef GPD_TASK_ACCOUNTING
+    task_account account;
+#endif
+
+private:
+    static deleter_t ** deleters() {
+        static deleter_t * table[slot_count];
+        return table;
+    }
+
+    // only the slots in 'used' are initialized
+    void * slots[slot_count];
+    std::uint32_t used = 0;
+};
+
+#ifdef GPD_TASK_ACCOUNTING
+inline void account_leave(fiber_storage * s) {
+    if (s) s->account.leave(account_clock());
+}
+
+inline void account_resume(fiber_storage * s) {
+    if (s) s->account.enter(account_clock(), true);
+}
+#endif
+
+/**
+ * Install a new storage for the lifetime of the scope; its values are
+ * destroyed on exit.
+ *
+ * The scope of the outermost frame of a context ('nested' false) is
+ * entered after its first switch in and left just before the last
+ * switch out, so nothing is restored on exit. A nested scope, for a
+ * stackless task or a pooled fiber job running inside the current
+ * context, restores the current storage.
+ *
+ * Without GPD_FIBER_LOCAL no storage is installed, as it would not be
+ * restored by the switches.
+ */
+#ifdef GPD_FIBER_LOCAL
+struct fiber_storage_scope {
+    explicit fiber_storage_scope(bool nested = false)
+        : saved(std::exchange(fiber_storage_current(), &storage))
+        , nested(nested) {
+#ifdef GPD_TASK_ACCOUNTING
+        auto now = account_clock();
+        if (nested && saved) saved->account.leave(now);
+        storage.account.enter(now, true);
+        task_account_registry::instance().add(storage.account);
+#endif
+    }
+
+    ~fiber_storage_scope() {
+        storage.clear();
+#ifdef GPD_TASK_ACCOUNTING
+        auto now = account_clock();
+        storage.account.leave(now);
+        task_account_registry::instance().remove(storage.account);
+        if (nested && saved) saved->account.enter(now, false);
+#endif
+        fiber_storage_current() = nested ? saved : 0;
+    }
+private:
+    fiber_storage storage;
+    fiber_storage * saved;
+    bool nested;
+};
+#else
+struct fiber_storage_scope {
+    explicit fiber_storage_scope(bool = false) {}
+};
+#endif
+
+}}
+#endif
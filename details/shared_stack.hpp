@@ -0,0 +1,190 @@
+#ifndef GPD_SHARED_STACK_HPP
+#define GPD_SHARED_STACK_HPP
+#include "switch_base.hpp"
+#include "stack_allocator.hpp"
+#include "guard.hpp"
+#include <exception>
+#include <cstring>
+#include <utility>
+
+/**
+ * Copy-on-park shared stack continuations.
+ *
+ * All shared-stack continuations of a thread execute on a single
+ * shared_stack. When a shared task switches out, its live stack slice
+ * [sp, top) is copied into a right sized private buffer; when it is
+ * resumed the slice is copied back at the same addresses.
+ *
+ * As the stack pointer of a parked shared task is not stable, it must
+ * never escape: each task has a tiny scratch stack, and every switch
+ * out of a shared task is routed (see stack_switch and execute_into
+ * in switch_base.hpp) through a trampoline on the scratch stack,
+ * which performs the switch on the task behalf. Other contexts thus
+ * only ever see the scratch stack pointer; when resumed, the
+ * trampoline copies the task slice back and resumes the task.
+ *
+ * The argument tuple sent by a switch is relocated into the buffer,
+ * so get() works as usual on a parked shared task.
+ *
+ * Restrictions: shared-stack tasks must be resumed on the thread that
+ * created them; objects on the stack of a parked shared task must not
+ * be referenced from other contexts, in particular references sent as
+ * continuation arguments (e.g. continuation<void(int&)>) are only
+ * valid for reading, writes are lost. The scheduler waiters, which
+ * live on the waiting task stack, can't be used from a shared-stack
+ * task.
+ *
+ * GPD_SHARED_STACK must be defined in all translation units of the
+ * program, as it changes the common switch path; libtask_shared_stack
+ * is libtask built that way.
+ */
+#ifndef GPD_SHARED_STACK_SIZE
+#define GPD_SHARED_STACK_SIZE (8*1024*1024)
+#endif
+
+namespace gpd { namespace details {
+
+struct shared_stack;
+
+struct shared_task {
+    enum { scratch_size = 16*1024 };
+
+    shared_task(shared_stack& stack)
+        : stack(&stack)
+        , scratch(static_cast<char*>(static_stack_allocator::allocate(scratch_size)))
+    {}
+
+    ~shared_task() {
+        static_stack_allocator::deallocate(scratch);
+        ::free(buffer);
+    }
+
+    shared_stack * stack;
+    char * scratch;
+    void * sp = 0;           // saved stack pointer, while parked
+    char * buffer = 0;       // saved stack slice
+    std::size_t capacity = 0;
+
+    // switch requested by the task, performed on the scratch stack
+    cont target;
+    parm_t parm;
+    trampoline_t * ex;
+    switch_pair result;
+    std::exception_ptr excp;
+};
+
+struct shared_stack {
+    enum { size = GPD_SHARED_STACK_SIZE };
+
+    shared_stack()
+        : base(static_cast<char*>(mmap_stack_allocator<>::allocate(size))) {}
+    ~shared_stack() { mmap_stack_allocator<>::deallocate(base, size); }
+
+    static shared_stack& local() {
+        static thread_local shared_stack stack;
+        return stack;
+    }
+
+    char * top() const { return base + size; }
+
+    // Copy the slice of the parked task 't' out of the stack. If
+    // 'parm' points inside the slice, relocate it to the copy.
+    void save(shared_task * t, parm_t * parm) {
+        char * sp = static_cast<char*>(t->sp);
+        std::size_t n = top() - sp;
+        if (t->capacity < n || t->capacity > 2*n) {
+            ::free(t->buffer);
+            t->buffer = static_cast<char*>(::malloc(n));
+            if (!t->buffer) throw std::bad_alloc();
+            t->capacity = n;
+        }
+        std::memcpy(t->buffer, sp, n);
+        if (*parm >= sp && *parm < top())
+            *parm = t->buffer + (static_cast<char*>(*parm) - sp);
+    }
+
+    void restore(shared_task * t) {
+        std::memcpy(t->sp, t->buffer, top() - static_cast<char*>(t->sp));
+    }
+
+    char * base;
+    shared_task * starting = 0; // task being created
+};
+
+inline shared_task*& shared_current() {
+    static thread_local shared_task * current = 0;
+    return current;
+}
+
+inline switch_pair shared_park_trampoline(parm_t p, cont from) {
+    auto t = static_cast<shared_task*>(p);
+    assert(t->stack == &shared_stack::local() &&
+           "shared stack tasks can't migrate between threads");
+    t->sp = from.sp;
+    t->stack->save(t, &t->parm);
+    switch_pair r = {{0}, 0};
+    try {
+        r = t->ex
+            ? execute_into_impl(t->parm, t->target, t->ex)
+            : stack_switch_impl(t->target, t->parm);
+    } catch(...) {
+        // an exception from a function run on top of the task: forward
+        // it to the task itself
+        t->excp = std::current_exception();
+    }
+    t->stack->restore(t);
+    t->result = r;
+    stack_switch_impl(cont{t->sp}, 0);
+    __builtin_unreachable();
+}
+
+inline switch_pair
+shared_park(shared_task * t, cont target, parm_t parm, trampoline_t * ex) {
+    t->target = target;
+    t->parm = parm;
+    t->ex = ex;
+    shared_current() = 0;
+    execute_into_impl(t, cont{ stack_bottom(t->scratch, shared_task::scratch_size) },
+                      &shared_park_trampoline);
+    shared_current() = t;
+    if (t->excp)
+        std::rethrow_exception(std::exchange(t->excp, nullptr));
+    return t->result;
+}
+
+/// Stack allocator for shared-stack continuations. The returned
+/// 'stack' is the thread shared stack; the per task state is owned by
+/// the allocator.
+struct shared_stack_allocator {
+    enum { stack_size = shared_stack::size };
+    static const size_t alignment = 16;
+
+    shared_task * task = 0;
+
+    void * allocate(size_t size = stack_size) {
+        assert(size == stack_size); (void)size;
+        auto& stack = shared_stack::local();
+        task = new shared_task(stack);
+        stack.starting = task;
+        return stack.base;
+    }
+
+    void deallocate(void *) throw() {
+        delete task;
+    }
+};
+
+/// Wraps the continuation body to track the running shared task.
+template<class F>
+struct shared_entry {
+    F f;
+    template<class C>
+    auto operator()(C c) -> decltype(f(std::move(c))) {
+        shared_current() = shared_stack::local().starting;
+        auto g = guard([] { shared_current() = 0; });
+        return f(std::move(c));
+    }
+};
+
+}}
+#endif
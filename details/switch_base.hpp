@@ -3,6 +3,10 @@
 #include <cassert>
 #include <stdint.h>
 #include <stddef.h>
+#ifdef GPD_INLINE_SWITCH
+#include <exception>
+#include <utility>
+#endif
 
 namespace gpd {
 typedef void* parm_t;
@@ -12,13 +16,6 @@ struct cont {
     explicit operator bool() const { return sp;}
 };
 
-inline void * stack_bottom(void * vp, size_t size) {
-    char * p = (char*)vp;
-    p += size ;
-    p -= 7*sizeof(void*);  
-    return p;
-}
-
 struct switch_pair {
     cont   sp;
     parm_t parm;
@@ -26,22 +23,90 @@ struct switch_pair {
 
 typedef switch_pair trampoline_t(parm_t parm, cont calling_continuation); 
 
+typedef switch_pair lazy_trampoline_t(parm_t args, cont calling_continuation,
+                                      parm_t parm);
+
+/// Return address planted in the outermost frame of every new
+/// context: its unwind info marks the return address as undefined, so
+/// debuggers, profilers and the C++ unwinder stop cleanly at the
+/// context entry instead of walking into stale stack contents.
+extern "C" void context_root_impl();
+asm (
+    ".text                         \n\t"
+    ".weak context_root_impl       \n\t"
+    ".type context_root_impl, @function \n\t"
+    ".align 16                     \n\t"
+    ".cfi_startproc                \n\t"
+    ".cfi_undefined rip            \n\t"
+    "nop                   \n\t"  // unwinders look up return address - 1
+    "context_root_impl:            \n\t"
+    "ud2                   \n\t"  // never returned to
+    ".cfi_endproc                  \n\t"
+    ".size context_root_impl, .-context_root_impl \n\t"
+    );
 
+// GPD_INLINE_SWITCH selects the inline asm backend, see
+// switch_base_alt.hpp.
+#ifdef GPD_INLINE_SWITCH
+#include "switch_base_alt.hpp"
+#else
+/// Initial frame of a new context on the stack [vp, vp + size), to be
+/// started with execute_into: null saved registers, frame pointer
+/// included, and context_root_impl as the trampoline return address.
+inline void * stack_bottom(void * vp, size_t size) {
+    char * p = (char*)vp;
+    p += size ;
+    p -= 7*sizeof(void*);  
+    void ** frame = (void**)p;
+    for (int i = 0; i < 6; ++i)
+        frame[i] = 0;
+    frame[6] = (void*)&context_root_impl;
+    return p;
+}
+
+
+// The .cfi directives describe the saved frame, so that the stack
+// can be unwound at any instruction of the switch: the frame of the
+// target context has the same layout.
 #define GPD_SAVE_REGISTERS                      \
     "pushq %rbx            \n\t"                \
+    ".cfi_adjust_cfa_offset 8 \n\t"             \
+    ".cfi_rel_offset rbx, 0 \n\t"               \
     "pushq %r12            \n\t"                \
+    ".cfi_adjust_cfa_offset 8 \n\t"             \
+    ".cfi_rel_offset r12, 0 \n\t"               \
     "pushq %r13            \n\t"                \
+    ".cfi_adjust_cfa_offset 8 \n\t"             \
+    ".cfi_rel_offset r13, 0 \n\t"               \
     "pushq %r14            \n\t"                \
+    ".cfi_adjust_cfa_offset 8 \n\t"             \
+    ".cfi_rel_offset r14, 0 \n\t"               \
     "pushq %r15            \n\t"                \
+    ".cfi_adjust_cfa_offset 8 \n\t"             \
+    ".cfi_rel_offset r15, 0 \n\t"               \
     "pushq %rbp            \n\t"                \
+    ".cfi_adjust_cfa_offset 8 \n\t"             \
+    ".cfi_rel_offset rbp, 0 \n\t"               \
 /**/
 #define GPD_RESTORE_REGISTERS                   \
     "popq %rbp             \n\t"                \
+    ".cfi_adjust_cfa_offset -8 \n\t"            \
+    ".cfi_restore rbp      \n\t"                \
     "popq %r15             \n\t"                \
+    ".cfi_adjust_cfa_offset -8 \n\t"            \
+    ".cfi_restore r15      \n\t"                \
     "popq %r14             \n\t"                \
+    ".cfi_adjust_cfa_offset -8 \n\t"            \
+    ".cfi_restore r14      \n\t"                \
     "popq %r13             \n\t"                \
+    ".cfi_adjust_cfa_offset -8 \n\t"            \
+    ".cfi_restore r13      \n\t"                \
     "popq %r12             \n\t"                \
+    ".cfi_adjust_cfa_offset -8 \n\t"            \
+    ".cfi_restore r12      \n\t"                \
     "popq %rbx             \n\t"                \
+    ".cfi_adjust_cfa_offset -8 \n\t"            \
+    ".cfi_restore rbx      \n\t"                \
 
 /**/
 
@@ -54,13 +119,18 @@ asm volatile (
     ".type stack_switch_impl, @function \n\t"            
     ".align 16                     \n\t"                           
     "stack_switch_impl:            \n\t"         
+    ".cfi_startproc                \n\t"
     GPD_SAVE_REGISTERS
     "movq %rsi, %rdx       \n\t"  // parm-> switch_pair::parm
     "movq %rsp, %rax       \n\t"  // rsp -> switch_pair::sp
     "movq %rdi, %rsp       \n\t"  // sp  -> rsp
     GPD_RESTORE_REGISTERS
     "popq %rdi             \n\t"
+    ".cfi_adjust_cfa_offset -8 \n\t"
+    ".cfi_register rip, rdi \n\t"
     "jmp *%rdi             \n\t"  // jump to ret address
+    ".cfi_endproc                  \n\t"
+    ".size stack_switch_impl, .-stack_switch_impl \n\t"
     );
 
 extern "C"
@@ -72,26 +142,149 @@ asm volatile (
     ".type execute_into_impl, @function \n\t"            
     ".align 16                     \n\t"                           
     "execute_into_impl:            \n\t"                
+    ".cfi_startproc                \n\t"
     GPD_SAVE_REGISTERS
     "movq %rsp, %rbx       \n\t"
     "movq %rsi, %rsp       \n\t" 
     "movq %rbx, %rsi       \n\t"
     GPD_RESTORE_REGISTERS
     "jmp *%rdx             \n\t"  //tail call (rdi is passed through)
+    ".cfi_endproc                  \n\t"
+    ".size execute_into_impl, .-execute_into_impl \n\t"
     );  
 
+/// Entry point of contexts created by make_context: invoke
+/// r12(rbx, rax, rdx), i.e. trampoline(args, calling continuation,
+/// parm). Entered with the padding slot of the frame on top of the
+/// stack, either jumped to by stack_switch or returned to by a
+/// trampoline run with execute_into.
+extern "C" void lazy_start_impl();
+asm (                            
+    ".text                         \n\t"                              
+    ".weak lazy_start_impl         \n\t"                   
+    ".type lazy_start_impl, @function \n\t"            
+    ".align 16                     \n\t"                           
+    "lazy_start_impl:              \n\t"                
+    ".cfi_startproc                \n\t"
+    ".cfi_def_cfa_offset 16        \n\t"  // return address: context_root_impl
+    "movq %rbx, %rdi       \n\t"  // args
+    "movq %rax, %rsi       \n\t"  // calling continuation
+    "addq $8, %rsp         \n\t"  // skip the padding
+    ".cfi_def_cfa_offset 8         \n\t"
+    "jmp *%r12             \n\t"  // tail call (rdx, parm, is passed through)
+    ".cfi_endproc                  \n\t"
+    ".size lazy_start_impl, .-lazy_start_impl \n\t"
+    );  
+
+/**
+ * Build, on the stack ending at 'top', the saved frame of a halted
+ * context that, when resumed with stack_switch or execute_into, calls
+ * 'ex(args, from, parm)'. Nothing runs on the new stack until then.
+ *
+ * 'top' must be 16 bytes aligned. The return address slot is 8 mod
+ * 16, as in any halted context, so that a trampoline run on the frame
+ * by execute_into is entered with an aligned stack; lazy_start_impl
+ * skips the padding above it to call 'ex' the same way.
+ */
+inline cont make_context(void * top, parm_t args, lazy_trampoline_t * ex) {
+    assert(((uintptr_t)top & 15) == 0);
+    void ** sp = (void**)top - 9;
+    sp[0] = 0;                          // rbp, outermost frame
+    sp[1] = sp[2] = sp[3] = 0;          // r15, r14, r13
+    sp[4] = (void*)ex;                  // r12
+    sp[5] = args;                       // rbx
+    sp[6] = (void*)&lazy_start_impl;    // return address
+    sp[7] = 0;                          // padding, for alignment
+    sp[8] = (void*)&context_root_impl;  // return address of the trampoline
+    return cont{sp};
+}
+
+/// True if 'sp' is a context built by make_context and never resumed.
+inline bool unstarted_context(cont sp) {
+    return ((void**)sp.sp)[6] == (void*)&lazy_start_impl;
+}
+#endif
+
+#ifdef GPD_SHARED_STACK
+// Hooks for shared-stack continuations, defined in shared_stack.hpp.
+// They change the inline stack_switch and execute_into below, so
+// GPD_SHARED_STACK must be defined alike in all translation units,
+// libraries included (link libtask_shared_stack instead of libtask).
+namespace details {
+struct shared_task;
+inline shared_task*& shared_current();
+inline switch_pair shared_park(shared_task*, cont, parm_t, trampoline_t*);
+}
+#endif
+
+// The accounting counters live in the fiber_local storage.
+#if defined(GPD_TASK_ACCOUNTING) && !defined(GPD_FIBER_LOCAL)
+#define GPD_FIBER_LOCAL
+#endif
+
+namespace details {
+struct fiber_storage;
+
+/// fiber_local storage of the running context, see fiber_storage.hpp.
+inline fiber_storage*& fiber_storage_current() {
+    static thread_local fiber_storage * current = 0;
+    return current;
+}
+
+#ifdef GPD_TASK_ACCOUNTING
+inline void account_leave(fiber_storage *);
+inline void account_resume(fiber_storage *);
+
+/// Each context restores its own fiber_local storage when resumed,
+/// and accounts its running time.
+struct fiber_storage_guard {
+    fiber_storage * saved = fiber_storage_current();
+    fiber_storage_guard() { account_leave(saved); }
+    ~fiber_storage_guard() {
+        fiber_storage_current() = saved;
+        account_resume(saved);
+    }
+};
+#elif defined(GPD_FIBER_LOCAL)
+/// Each context restores its own fiber_local storage when resumed.
+struct fiber_storage_guard {
+    fiber_storage * saved = fiber_storage_current();
+    ~fiber_storage_guard() { fiber_storage_current() = saved; }
+};
+#else
+/// Without fiber_local, the switch path is left alone.
+struct fiber_storage_guard {
+    fiber_storage_guard() {}
+};
+#endif
+}
+
 inline switch_pair
 stack_switch(cont sp, parm_t parm) {
+    details::fiber_storage_guard _;
+#ifdef GPD_SHARED_STACK
+    if (auto t = details::shared_current())
+        return details::shared_park(t, sp, parm, 0);
+#endif
     return stack_switch_impl(sp, parm);
 }
    
 inline
 switch_pair 
 execute_into(parm_t parm, cont sp, trampoline_t * ex) {
+    details::fiber_storage_guard _;
+#ifdef GPD_SHARED_STACK
+    if (auto t = details::shared_current())
+        return details::shared_park(t, sp, parm, ex);
+#endif
     return execute_into_impl(parm, sp, ex);
 }
 
 
 }
+
+#ifdef GPD_TASK_ACCOUNTING
+#include "fiber_storage.hpp"
+#endif
 #endif
 
@@ -1,79 +1,188 @@
 #ifndef GPD_SWITCH_BASE_ALT_HPP
 #define GPD_SWITCH_BASE_ALT_HPP
-#include <cassert>
-#include <stdint.h>
-#include <stddef.h>
+#ifndef GPD_SWITCH_BASE_HPP
+#error "include switch_base.hpp and define GPD_INLINE_SWITCH instead"
+#endif
 
-namespace gpd {
+/**
+ * Inline asm switch backend, selected with GPD_INLINE_SWITCH.
+ *
+ * The switch is expanded inline and, instead of unconditionally
+ * saving the callee saved registers, declares all registers as
+ * clobbered: the compiler only spills the values which are actually
+ * live across the switch and can keep the others in registers.
+ *
+ * A halted context saves just the frame pointer and the resume
+ * address, plus its original stack pointer: the switch skips the red
+ * zone and realigns the stack before pushing, so that trampolines
+ * executed on top of the context are entered with a correctly
+ * aligned stack. The resumed context receives the calling
+ * continuation in rax and the parameter in rdx, as the result of a
+ * trampoline.
+ *
+ * Halted contexts are not compatible with the ones of the default
+ * backend: all translation units must be compiled with the same
+ * backend.
+ *
+ * The resume address is in the middle of an asm statement, which the
+ * unwinder can't cross: trampolines are run via trampoline_guard,
+ * which catches any exception they throw and hands it over to the
+ * resumed context, which rethrows it after the switch.
+ */
 
-typedef void* parm_t;
+#ifdef __AVX512F__
+#define GPD_CLOBBER_LIST_AVX512                                         \
+    , "xmm16", "xmm17", "xmm18", "xmm19", "xmm20", "xmm21", "xmm22", "xmm23" \
+    , "xmm24", "xmm25", "xmm26", "xmm27", "xmm28", "xmm29", "xmm30", "xmm31" \
+    /**/
+#else
+#define GPD_CLOBBER_LIST_AVX512
+#endif
 
-struct cont { 
-    void * rsp; 
-    explicit operator bool() const { return rsp;}
-};
+#define GPD_CLOBBER_LIST                                               \
+    , "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"              \
+        , "xmm0", "xmm1", "xmm2" , "xmm3" , "xmm4" , "xmm5" , "xmm6" , "xmm7" \
+        , "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15" \
+        ,"st",  "st(1)", "st(2)", "st(3)", "st(4)", "st(5)", "st(6)", "st(7)" \
+        GPD_CLOBBER_LIST_AVX512                                         \
+    , "memory", "cc"                                                    \
+    /**/
+
+// Halt the current context: save the original stack pointer (in
+// 'orig'), the resume address and the frame pointer below the red zone.
+#define GPD_INLINE_SAVE(orig, tmp)                      \
+    "movq  %%rsp, %%" orig "       \n\t"                \
+    "leaq  -128(%%rsp), %%rsp      \n\t"                \
+    "andq  $-16, %%rsp             \n\t"                \
+    "subq  $8, %%rsp               \n\t"                \
+    "pushq %%" orig "              \n\t"                \
+    "leaq  1f(%%rip), %%" tmp "    \n\t"                \
+    "pushq %%" tmp "               \n\t"                \
+    "pushq %%rbp                   \n\t"                \
+/**/
+
+// Resume address of a halted context.
+#define GPD_INLINE_RESUME                       \
+    "1:                            \n\t"        \
+    "movq  (%%rsp), %%rsp          \n\t"        \
+/**/
+
+// Included by switch_base.hpp inside namespace gpd.
 
-void * stack_bottom(void * vp, size_t size) {
+// Initial frame of a new context, see switch_base.hpp.
+inline void * stack_bottom(void * vp, size_t size) {
     char * p = (char*)vp;
     p += size ;
-    p -= 7*sizeof(void*);  
+    p -= 2*sizeof(void*);
+    void ** frame = (void**)p;
+    frame[0] = 0;                               // rbp
+    frame[1] = (void*)&context_root_impl;       // trampoline return address
     return p;
 }
 
-struct switch_pair {
-    cont   sp;
-    parm_t parm;
-};
+namespace details {
+inline std::exception_ptr& pending_switch_exception() {
+    static thread_local std::exception_ptr excp;
+    return excp;
+}
+
+/// Run 'ex' on top of a halted context; if it throws, resume the
+/// context with the marker &trampoline_guard as calling continuation,
+/// the exception is rethrown by the context.
+inline switch_pair
+trampoline_guard(parm_t parm, cont from, trampoline_t * ex) {
+    try {
+        return ex(parm, from);
+    } catch(...) {
+        pending_switch_exception() = std::current_exception();
+        return switch_pair{ cont{ (void*)&trampoline_guard }, 0 };
+    }
+}
 
-typedef switch_pair trampoline_t(parm_t parm, cont calling_continuation); 
+[[noreturn]] inline void rethrow_switch_exception() {
+    std::rethrow_exception(std::exchange(pending_switch_exception(), nullptr));
+}
 
-#define GPD_CLOBBER_LIST                                               \
-    , "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"              \
-        , "xmm0", "xmm1", "xmm2" , "xmm3" , "xmm4" , "xmm5" , "xmm6" , "xmm7" \
-        , "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15" \
-        ,"st",  "st(1)", "st(2)", "st(3)", "st(4)", "st(5)", "st(6)", "st(7)" \
-    , "memory"                                                          \
-    /**/
+inline switch_pair checked_resume(switch_pair r) {
+    if (__builtin_expect(r.sp.sp == (void*)&trampoline_guard, false))
+        rethrow_switch_exception();
+    return r;
+}
+}
 
 inline switch_pair
-stack_switch(cont sp, parm_t parm) {
-    asm (
-        "pushq $1f          \n\t"
-        "pushq %%rbp        \n\t"
-        "movq  %%rsp, %%rbx \n\t"
-        "movq  %%rax, %%rsp \n\t"
-        "popq  %%rbp        \n\t"
-        "popq  %%rsi        \n\t"
-        "jmp  *%%rsi        \n\t"
-        "1:                 \n\t"
-        :  "=b"(sp.rsp), "+d"(parm)
-        :  "b" (sp.rsp)
-        : "rsi", "rdi",, "rcx"
+stack_switch_impl(cont sp, parm_t parm) {
+    void * from;
+    asm volatile (
+        GPD_INLINE_SAVE("rdi", "rcx")
+        "movq  %%rsp, %%rax            \n\t"
+        "movq  %%rsi, %%rsp            \n\t"
+        "popq  %%rbp                   \n\t"
+        "popq  %%rcx                   \n\t"
+        "jmp   *%%rcx                  \n\t"
+        GPD_INLINE_RESUME
+        : "=a"(from), "+d"(parm), "+S"(sp.sp)
+        :
+        : "rbx", "rcx", "rdi"
           GPD_CLOBBER_LIST
         );
-    return switch_pair{sp, parm};
+    return details::checked_resume(switch_pair{cont{from}, parm});
 }
 
-typedef switch_pair trampoline_t(parm_t parm, cont calling_continuation); 
-   
-inline
-switch_pair 
-execute_into(parm_t parm, cont sp, trampoline_t * ex) {
-    switch_pair ret;
-    asm ( 
-        "pushq $1f          \n\t"
-        "pushq %%rbp        \n\t"
-        "xchg  %%rsi, %%rsp \n\t"
-        "popq  %%rbp        \n\t"
-        "jmp  *%%rbx        \n\t"
-        "1:                \n\t"
-        : "=d"(ret.parm), "=a"(ret.sp)
-        : "D"(parm), "S"(sp), "b"(ex) 
-        : "rcx"
+inline switch_pair
+execute_into_impl(parm_t parm, cont sp, trampoline_t * ex) {
+    void * from;
+    void * guard = (void*)&details::trampoline_guard;
+    void * d = (void*)ex;
+    asm volatile (
+        GPD_INLINE_SAVE("r11", "rax")
+        "xchgq %%rsi, %%rsp            \n\t"
+        "popq  %%rbp                   \n\t"
+        "jmp   *%%rcx                  \n\t" // trampoline_guard(rdi, rsi, rdx)
+        GPD_INLINE_RESUME
+        : "=a"(from), "+d"(d), "+D"(parm), "+S"(sp.sp), "+c"(guard)
+        :
+        : "rbx"
           GPD_CLOBBER_LIST
         );
-    return ret;
+    return details::checked_resume(switch_pair{cont{from}, d});
 }
 
+/// Entry point of contexts created by make_context: invoke
+/// ex(args, rax, rdx), where ex and args are on the stack.
+extern "C" void lazy_start_alt_impl();
+asm (
+    ".text                         \n\t"
+    ".weak lazy_start_alt_impl     \n\t"
+    ".type lazy_start_alt_impl, @function \n\t"
+    ".align 16                     \n\t"
+    "lazy_start_alt_impl:          \n\t"
+    ".cfi_startproc                \n\t"
+    ".cfi_def_cfa_offset 32        \n\t"  // return address: context_root_impl
+    "movq (%rsp), %rcx     \n\t"  // ex
+    "movq 8(%rsp), %rdi    \n\t"  // args
+    "movq %rax, %rsi       \n\t"  // calling continuation
+    "addq $24, %rsp        \n\t"
+    ".cfi_def_cfa_offset 8         \n\t"
+    "jmp *%rcx             \n\t"  // tail call (rdx, parm, is passed through)
+    ".cfi_endproc                  \n\t"
+    ".size lazy_start_alt_impl, .-lazy_start_alt_impl \n\t"
+    );
+
+inline cont make_context(void * top, parm_t args, lazy_trampoline_t * ex) {
+    assert(((uintptr_t)top & 15) == 0);
+    void ** sp = (void**)top - 6;
+    sp[0] = 0;                              // rbp, outermost frame
+    sp[1] = (void*)&lazy_start_alt_impl;    // resume address
+    sp[2] = (void*)ex;
+    sp[3] = args;
+    sp[4] = 0;                              // padding, for alignment
+    sp[5] = (void*)&context_root_impl;      // return address of the trampoline
+    return cont{sp};
 }
+
+inline bool unstarted_context(cont sp) {
+    return ((void**)sp.sp)[1] == (void*)&lazy_start_alt_impl;
+}
+
 #endif
@@ -6,6 +6,9 @@ struct switch_pair_accessor {
     template<class X>
     static switch_pair pilfer(X&& x) { return x.pilfer(); }
 
+    template<class X>
+    static switch_pair get(const X& x) { return x.pair; }
+
 };
 }}
 #endif
@@ -0,0 +1,139 @@
+#ifndef GPD_TASK_ACCOUNT_HPP
+#define GPD_TASK_ACCOUNT_HPP
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gpd {
+
+/// Scheduling counters of an execution context.
+struct task_stats {
+    /// TSC cycles spent running.
+    std::uint64_t cycles = 0;
+    /// Number of times the context has been started or resumed.
+    std::uint64_t resumes = 0;
+    /// Resumes on a different thread (i.e. scheduler) than the previous.
+    std::uint64_t migrations = 0;
+};
+
+/// A context, or the aggregate of the finished contexts with 'label'.
+struct task_usage {
+    std::string label;
+    task_stats stats;
+    bool live;
+};
+
+namespace details {
+
+inline std::uint64_t account_clock() { return __builtin_ia32_rdtsc(); }
+
+inline const void * account_thread() {
+    static thread_local char tag;
+    return &tag;
+}
+
+/// Counters of a context, updated by the context itself only, on
+/// switches. The registry reads them concurrently, hence the relaxed
+/// atomics.
+struct task_account {
+    task_account()
+        : started_at(account_clock()), thread(account_thread()) {}
+    task_account(const task_account&) = delete;
+
+    void enter(std::uint64_t now, bool resume) {
+        started_at = now;
+        if (!resume)
+            return;
+        bump(resumes, 1);
+        const void * here = account_thread();
+        if (here != thread) {
+            bump(migrations, 1);
+            thread = here;
+        }
+    }
+
+    void leave(std::uint64_t now) {
+        bump(cycles, now - started_at);
+    }
+
+    task_stats stats() const {
+        task_stats r;
+        r.cycles = cycles.load(std::memory_order_relaxed);
+        r.resumes = resumes.load(std::memory_order_relaxed);
+        r.migrations = migrations.load(std::memory_order_relaxed);
+        return r;
+    }
+
+    const char * label = 0;
+    task_account * prev = 0;
+    task_account * next = 0;
+
+private:
+    static void bump(std::atomic<std::uint64_t>& x, std::uint64_t n) {
+        x.store(x.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::atomic<std::uint64_t> cycles = { 0 };
+    std::atomic<std::uint64_t> resumes = { 0 };
+    std::atomic<std::uint64_t> migrations = { 0 };
+    std::uint64_t started_at;
+    const void * thread;
+};
+
+/// Process wide list of the live contexts, and totals of the finished
+/// ones by label.
+struct task_account_registry {
+    static task_account_registry& instance() {
+        static task_account_registry registry;
+        return registry;
+    }
+
+    void add(task_account& a) {
+        std::lock_guard<std::mutex> _(mux);
+        a.next = live;
+        if (live) live->prev = &a;
+        live = &a;
+    }
+
+    void remove(task_account& a) {
+        task_stats s = a.stats();
+        std::lock_guard<std::mutex> _(mux);
+        (a.prev ? a.prev->next : live) = a.next;
+        if (a.next) a.next->prev = a.prev;
+        auto& total = finished[a.label ? a.label : "(unlabelled)"];
+        total.cycles += s.cycles;
+        total.resumes += s.resumes;
+        total.migrations += s.migrations;
+    }
+
+    void set_label(task_account& a, const char * label) {
+        std::lock_guard<std::mutex> _(mux);
+        a.label = label;
+    }
+
+    std::vector<task_usage> snapshot() {
+        std::vector<task_usage> result;
+        std::lock_guard<std::mutex> _(mux);
+        for (auto a = live; a; a = a->next)
+            result.push_back({ a->label ? a->label : "(unlabelled)", a->stats(), true });
+        for (auto& f : finished)
+            result.push_back({ f.first, f.second, false });
+        return result;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> _(mux);
+        finished.clear();
+    }
+
+private:
+    std::mutex mux;
+    task_account * live = 0;
+    std::map<std::string, task_stats> finished;
+};
+
+}}
+#endif
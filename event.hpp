@@ -3,35 +3,101 @@
 #include <atomic>
 #include <memory>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "details/deadline.hpp"
 
 namespace gpd {
-struct event;
-using event_ptr = std::unique_ptr<event>;
+
+/// Polymorphic base of all events, owned by event_ptr.
+struct event_base {
+    virtual ~event_base() {}
+};
+
+using event_ptr = std::unique_ptr<event_base>;
 struct waiter {
     // this might be destroyed after calling 'signal'
     virtual void signal(event_ptr) = 0;
+
+    // Signal 'n' events at once, see signal_many; consumes ps[0..n).
+    // Waiters which can coalesce the wake ups override this.
+    virtual void signal_many(event_ptr * ps, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+            signal(std::move(ps[i]));
+    }
     virtual ~waiter() {}
+
+    // What the events call to signal 'e': the plain function of a
+    // direct_waiter, if any, otherwise 'signal'.
+    void notify(event_base * e) {
+        if (notify_fn)
+            notify_fn(this, e);
+        else
+            signal(event_ptr(e));
+    }
+
+protected:
+    using notify_t = void (*)(waiter *, event_base *);
+    waiter(notify_t notify_fn = nullptr) : notify_fn(notify_fn) {}
+
+private:
+    notify_t notify_fn;
 };
 
-struct delete_waiter_t : waiter {
-    virtual void signal(event_ptr p) override { (void)p; };
+/// Base of the waiters on the hot completion paths. 'Derived' defines
+/// 'void on_signal(event_base * e)', with the semantics of
+/// signal(event_ptr(e)), which the events reach through a plain
+/// function pointer: no vtable load, and no event_ptr to destroy after
+/// the call. 'signal' is kept for everything else.
+template<class Derived>
+struct direct_waiter : waiter {
+    direct_waiter() : waiter(&direct_waiter::call) {}
+
+    void signal(event_ptr p) override {
+        static_cast<Derived*>(this)->on_signal(p.release());
+    }
+
+private:
+    static void call(waiter * w, event_base * e) {
+        static_cast<Derived*>(static_cast<direct_waiter*>(w))->on_signal(e);
+    }
+};
+
+struct delete_waiter_t : direct_waiter<delete_waiter_t> {
+    void on_signal(event_base * e) { delete e; }
     virtual ~delete_waiter_t() override {}
 };
 
-struct noop_waiter_t : waiter {
-    virtual void signal(event_ptr p) override { p.release(); };
+struct noop_waiter_t : direct_waiter<noop_waiter_t> {
+    void on_signal(event_base *) {}
     virtual ~noop_waiter_t() override {}
 };
 
 extern delete_waiter_t delete_waiter;
 extern noop_waiter_t noop_waiter;
 
+/// Event implementation policies, see basic_event.
+///@{
+struct waitfree_event_policy {};
+struct dekker_like_event_policy {};
+struct mixed_atomics_event_policy {};
+///@}
 
 #define GPD_EVENT_IMPL_WAITFREE 1
 #define GPD_EVENT_IMPL_DEKKER_LIKE 2
 #define GPD_EVENT_IMPL_MIXED_ATOMICS 3
 
+// Selects the implementation of 'event', the event type of futures
+// and of the wait functions.
+#ifndef GPD_EVENT_IMPL
 #define GPD_EVENT_IMPL GPD_EVENT_IMPL_WAITFREE
+#endif
 
 // Synchronize a producer and a consumer via a continuation.
 //
@@ -43,25 +109,36 @@ extern noop_waiter_t noop_waiter;
 // listen for the producer event. A registered callback can be unregistered .
 //
 // The event can be in three states: empty, waited, signaled.
-#if GPD_EVENT_IMPL == GPD_EVENT_IMPL_WAITFREE
+//
+// All implementations coexist, selected by 'Policy', so that e.g. the
+// dekker-like one can be used for wide wait_many fan-in and the
+// wait-free one elsewhere in the same program.
+template<class Policy>
+struct basic_event;
+
 /// This is the straight-forward implementation. 'Signal' uses a plain
 /// exchange, 'wait' and dismiss_wait' use a single strong CAS,
 /// Assuming exchange and CAS are waitfree, all operations are also
 /// waitfree.
-struct event 
+template<>
+struct basic_event<waitfree_event_policy> : event_base
 {
-    event(event&) = delete;
-    void operator=(event&&) = delete;
-    event(bool empty = true) : state(empty ? event::empty : signaled ) {}
+    basic_event(basic_event&) = delete;
+    void operator=(basic_event&&) = delete;
+    basic_event(bool empty = true) : state(empty ? basic_event::empty : signaled ) {}
 
     // Put the event in the signaled state. If the event was in the
     // waited state invoke the callback (and leave the event in the
     // signaled state).
     void signal()  {
-        auto w = state.exchange(signaled);
+        if (auto w = mark_signaled())
+            w->notify(this);
+    }
 
-        if (w)
-            w->signal(event_ptr (this));
+    // The first half of 'signal': put the event in the signaled state
+    // and return the waiter to signal, if any.
+    waiter * mark_signaled() {
+        return state.exchange(signaled);
     }
 
     // Register a callback with the event. If the event is already
@@ -71,7 +148,7 @@ struct event
     // Pre: state != waited
     void wait(waiter * w) {
         if (!try_wait(w))  
-            w->signal(event_ptr(this));
+            w->notify(this);
     }
 
     // If the event is in the signaled state, return false, otherwise
@@ -84,6 +161,10 @@ struct event
         return (old_w != signaled && state.compare_exchange_strong(old_w, w));
     }
       
+    // Whether the event is in the signaled state. Once it is,
+    // 'signal' no longer touches the event.
+    bool is_signaled() const { return get_waiter() == signaled; }
+
     // If the event is in the waited or empty state, put it into the
     // empty state and return true, otherwise return false and leave
     // it in the signaled state.
@@ -117,13 +198,32 @@ struct event
     // Return the number of successfull dismissals.
     template<class Iter>
     static std::size_t dismiss_wait_many(waiter * w, Iter begin, Iter end) {
+        return dismiss_wait_many(w, begin, end, [](std::size_t) {});
+    }
+
+    // As above, also call signaled(i) for the i-th element of the
+    // range if its event could not be dismissed, i.e. is signaled.
+    template<class Iter, class F>
+    static std::size_t dismiss_wait_many(waiter * w, Iter begin, Iter end, F&& signaled) {
         std::size_t count = 0;
-        for (auto  i = begin; i != end; ++i)
-            if (auto e = get_event(*i)) count += e->dismiss_wait(w);
+        std::size_t index = 0;
+        for (auto  i = begin; i != end; ++i, ++index)
+            if (auto e = get_event(*i)) {
+                if (e->dismiss_wait(w))
+                    ++count;
+                else
+                    signaled(index);
+            }
         return count;
     }
 
-    virtual ~event()  {}
+    // The low half of the state, which changes on signal and
+    // dismiss_wait, for waiters that sleep on the event itself
+    // (x86 is little endian).
+    std::uint32_t * futex_word() {
+        return reinterpret_cast<std::uint32_t*>(&state);
+    }
+
 private:
     waiter* get_waiter() const { return state.load(std::memory_order_acquire); }
     // msb is the signaled bit
@@ -133,9 +233,6 @@ private:
                              
 };
 
-#elif (GPD_EVENT_IMPL == GPD_EVENT_IMPL_DEKKER_LIKE || \
-       GPD_EVENT_IMPL == GPD_EVENT_IMPL_MIXED_ATOMICS)
-
 /// The dekker-like implementation uses a pure store+load mutual
 /// exclusion mechanism between 'signal' and both 'wait' and
 /// 'dismiss_wait'. We trade an RMW with a store+fence+load and the
@@ -151,44 +248,67 @@ private:
 /// implementation relies on a double pointer sized DCAS being able to
 /// syncronize with pointer sized read ans stores; this is explicitly
 /// undefined behaviour in C++11, but it should work fine if the
-/// underlying hardware has native support for DCAS (or LL/SC).
-struct event 
+/// underlying hardware has native support for DCAS (or LL/SC). The
+/// DCAS is a cmpxchg16b (requires -mcx16), as std::atomic of a
+/// pointer pair is not lock free with recent compilers.
+template<class Policy>
+struct basic_event : event_base
 {
-    event(event&) = delete;
-    void operator=(event&&) = delete;
-    event(bool shared = true) {
+    static_assert(std::is_same<Policy, dekker_like_event_policy>::value ||
+                  std::is_same<Policy, mixed_atomics_event_policy>::value,
+                  "unknown event policy");
+    static constexpr bool dekker_like =
+        std::is_same<Policy, dekker_like_event_policy>::value;
+#ifndef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+    static_assert(dekker_like,
+                  "the mixed-atomics event requires cmpxchg16b, build with -mcx16");
+#endif
+
+    basic_event(basic_event&) = delete;
+    void operator=(basic_event&&) = delete;
+    basic_event(bool shared = true) {
         pair.waited.store(0, std::memory_order_relaxed);
         pair.signaled.store(shared ? state_t::empty : state_t::signaled,
                        std::memory_order_relaxed);
     }
     
     void signal()  {
-#if    GPD_EVENT_IMPL == GPD_EVENT_IMPL_DEKKER_LIKE
-        pair.signaled.store(state_t::critical, std::memory_order_relaxed);
-        std::atomic_thread_fence(std::memory_order_seq_cst);
-        auto w = pair.waited.load(std::memory_order_acquire);
-        if (!w)
-            pair.signaled.store(state_t::signaled, std::memory_order_release);
-        else {
-            pair.signaled.store(state_t::fired, std::memory_order_release);
-            w->signal(event_ptr (this));
+        if (auto w = mark_signaled())
+            w->notify(this);
+    }
+
+    waiter * mark_signaled() {
+        if (dekker_like) {
+            pair.signaled.store(state_t::critical, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto w = pair.waited.load(std::memory_order_acquire);
+            pair.signaled.store(w ? state_t::fired : state_t::signaled,
+                                std::memory_order_release);
+            return w;
+        } else {
+            auto p = reinterpret_cast<volatile unsigned __int128*>(&pair);
+            image_t old { pair.waited.load(std::memory_order_relaxed),
+                          state_t::empty };
+            unsigned __int128 old_bits = 0;
+            std::memcpy(&old_bits, &old, image_size);
+            while (true) {
+                image_t next { old.waited,
+                        old.waited ? state_t::fired : state_t::signaled };
+                unsigned __int128 next_bits = old_bits;
+                std::memcpy(&next_bits, &next, image_size);
+                auto seen = __sync_val_compare_and_swap(p, old_bits, next_bits);
+                if (seen == old_bits)
+                    break;
+                old_bits = seen;
+                std::memcpy(&old, &old_bits, image_size);
+            }
+            return old.waited;
         }
-#else // GPD_EVENT_IMPL == GPD_EVENT_IMPL_MIXED_ATOMICS
-        assert(atomic_pair.is_lock_free());
-        auto w  = pair.waited.load(std::memory_order_relaxed);
-        atomic_pair_t old { w, state_t::empty };
-        while (! atomic_pair.compare_exchange_strong(
-                   old, 
-                   atomic_pair_t{ old.waited,
-                           old.waited ? state_t::fired : state_t:: signaled }))
-               ;         
-        if (old.waited) old.waited->signal(event_ptr (this));
-#endif        
     }
 
     void wait(waiter * w) {
         if (!try_wait(w))  
-            w->signal(event_ptr(this));
+            w->notify(this);
     }
 
     bool try_wait(waiter * w) {
@@ -203,6 +323,11 @@ struct event
         return waited;
     }
 
+    bool is_signaled() const {
+        auto s = pair.signaled.load(std::memory_order_acquire);
+        return s == state_t::signaled || s == state_t::fired;
+    }
+
     __attribute__((warn_unused_result))
     bool dismiss_wait(waiter*) {
         pair.waited.store(0, std::memory_order_release);
@@ -233,56 +358,69 @@ struct event
     }
     
     template<class Iter>
-    static std::size_t dismiss_wait_many(waiter *, Iter begin, Iter end) {
+    static std::size_t dismiss_wait_many(waiter * w, Iter begin, Iter end) {
+        return dismiss_wait_many(w, begin, end, [](std::size_t) {});
+    }
+
+    template<class Iter, class F>
+    static std::size_t dismiss_wait_many(waiter *, Iter begin, Iter end, F&& signaled) {
         for (auto  i = begin; i != end; ++i)
             if (auto e = get_event(*i)) {
                 e->pair.waited.store(0, std::memory_order_release);;
             }
         std::atomic_thread_fence(std::memory_order_seq_cst);
         std::size_t count = 0;
-        for (auto  i = begin; i != end; ++i)
+        std::size_t index = 0;
+        for (auto  i = begin; i != end; ++i, ++index)
             if (auto e = get_event(*i)) {
-                count += e->was_waited && e->load_state() != state_t::fired;
+                if (e->was_waited && e->load_state() != state_t::fired)
+                    ++count;
+                else
+                    signaled(index);
             }
         return count;
     }
 
-    virtual ~event()  {}
 private:
     enum class state_t { empty, critical, signaled, fired };
 
     state_t load_state() const {
         auto s = pair.signaled.load(std::memory_order_acquire);
-#if    GPD_EVENT_IMPL == GPD_EVENT_IMPL_DEKKER_LIKE
-        while (s == state_t::critical) {
-            s = pair.signaled.load(std::memory_order_acquire);
-            __builtin_ia32_pause();
-        }
-#endif
+        if (dekker_like)
+            while (s == state_t::critical) {
+                s = pair.signaled.load(std::memory_order_acquire);
+                __builtin_ia32_pause();
+            }
         assert(s != state_t::critical);
         return s;
     }
-  
 
-    struct atomic_pair_t {
+    // plain image of 'pair', for the DCAS
+    struct image_t {
         waiter* waited; 
         state_t signaled;
     };
+    static constexpr std::size_t image_size = sizeof(waiter*) + sizeof(state_t);
 
-    struct pair_t {
+    struct alignas(16) pair_t {
     std::atomic<waiter*> waited;
     std::atomic<state_t> signaled;
     };
+    static_assert(sizeof(pair_t) == 16, "DCAS on the waited/signaled pair");
     
-    
-    union alignas(sizeof(pair_t)) {
-        std::atomic<atomic_pair_t> atomic_pair;
-        pair_t                     pair;
-    };
+    pair_t pair;
     bool was_waited;
                              
 } ;
 
+#if GPD_EVENT_IMPL == GPD_EVENT_IMPL_WAITFREE
+using event = basic_event<waitfree_event_policy>;
+#elif GPD_EVENT_IMPL == GPD_EVENT_IMPL_DEKKER_LIKE
+using event = basic_event<dekker_like_event_policy>;
+#elif GPD_EVENT_IMPL == GPD_EVENT_IMPL_MIXED_ATOMICS
+using event = basic_event<mixed_atomics_event_policy>;
+#else
+#error "unknown GPD_EVENT_IMPL"
 #endif
 
 // ADL customization point. Given a "Waitable", returns an event
@@ -292,7 +430,19 @@ private:
 template<class T>
 event* get_event(T& x);
 
-inline event * get_event(event *e) { return e; }
+inline basic_event<waitfree_event_policy> *
+get_event(basic_event<waitfree_event_policy> *e) { return e; }
+
+inline basic_event<dekker_like_event_policy> *
+get_event(basic_event<dekker_like_event_policy> *e) { return e; }
+
+inline basic_event<mixed_atomics_event_policy> *
+get_event(basic_event<mixed_atomics_event_policy> *e) { return e; }
+
+/// The event type of the elements of a range of Waitables.
+template<class WaitableRange>
+using range_event_t = std::remove_pointer_t<
+    decltype(get_event(*std::begin(std::declval<WaitableRange&>())))>;
 
 /// ADL customization points for Waiters
 ///
@@ -323,6 +473,10 @@ struct CountdownLatch : waiter {
     /// be called concurrently with other calls to signal, but not
     /// wait
     void wait(std::uint32_t  target = 1);
+
+    /// As wait, but give up at 'deadline'. On timeout the count is
+    /// restored to its value before the call and false is returned.
+    bool wait_until(std::uint32_t target, deadline_clock::time_point deadline);
 };
 
 
@@ -342,38 +496,89 @@ template<class CountdownLatch, class WaitableRange>
 auto wait_all_adl(CountdownLatch& latch, WaitableRange&& events) ->
     void_t<decltype(std::begin(events)), decltype(std::end(events))> {
     latch.reset();
-    std::size_t waited =
-        event::wait_many(&latch, std::begin(events), std::end(events)).second;
+    std::size_t waited = range_event_t<WaitableRange>::wait_many(
+        &latch, std::begin(events), std::end(events)).second;
     if (waited)
         latch.wait(waited);
 }
 
-template<class CountdownLatch, class WaitableRange>
-auto wait_any_adl(CountdownLatch& latch, WaitableRange&& events) ->
-    void_t<decltype(std::begin(events)), decltype(std::end(events))> {
+namespace details {
+/// Wait for 'k' of the Waitables of a range with a CountdownLatch,
+/// then dismiss the others. Call ready(i) for the i-th Waitable of
+/// the range if it is ready, as learned while dismissing the waits:
+/// no further scan is needed to find it.
+///
+/// Pre: the range has at least 'k' Waitables with an event.
+template<class CountdownLatch, class WaitableRange, class F>
+void latch_wait_some(CountdownLatch& latch, std::size_t k, WaitableRange& events,
+                     F&& ready) {
     latch.reset();
     std::size_t signaled;
     std::size_t waited;
+    using event_type = range_event_t<WaitableRange>;
     std::tie(signaled, waited) =
-        event::wait_many(&latch, std::begin(events), std::end(events));
+        event_type::wait_many(&latch, std::begin(events), std::end(events));
     assert(signaled + waited <=
            (std::size_t)std::distance(std::begin(events), std::end(events)));
-    if (signaled == 0) 
-        latch.wait();
+    assert(signaled + waited >= k);
+    const std::size_t needed = signaled < k ? k - signaled : 0;
+    if (needed)
+        latch.wait(needed);
         
     const std::size_t dismissed =
-        event::dismiss_wait_many(&latch, std::begin(events), std::end(events));
+        event_type::dismiss_wait_many(&latch, std::begin(events), std::end(events), ready);
     assert(dismissed <= waited);
     std::ptrdiff_t pending = waited - dismissed;
-    assert(pending >= 0);
-    assert( signaled != 0 || pending >= 1 );
-    if (signaled == 0) {
-        assert(pending >= 1);
-        pending -= 1;
-    }
+    assert(pending >= std::ptrdiff_t(needed));
+    pending -= needed;
     if (pending)
         latch.wait(pending);
+}
+}
 
+/// Return the index in the range of the first ready Waitable.
+template<class CountdownLatch, class WaitableRange>
+auto wait_any_adl(CountdownLatch& latch, WaitableRange&& events) ->
+    decltype(std::begin(events), std::end(events), std::size_t()) {
+    std::size_t first = std::size_t(-1);
+    details::latch_wait_some(latch, 1, events, [&](std::size_t i) {
+            if (i < first) first = i;
+        });
+    assert(first != std::size_t(-1));
+    return first;
+}
+
+/// Set ready[i], resized to the range, for each ready Waitable of the
+/// range and return their number.
+template<class CountdownLatch, class WaitableRange>
+auto wait_any_ready_adl(CountdownLatch& latch, std::vector<bool>& ready,
+                        WaitableRange&& events) ->
+    decltype(std::begin(events), std::end(events), std::size_t()) {
+    ready.assign(std::distance(std::begin(events), std::end(events)), false);
+    std::size_t count = 0;
+    details::latch_wait_some(latch, 1, events, [&](std::size_t i) {
+            ready[i] = true;
+            ++count;
+        });
+    assert(count);
+    return count;
+}
+
+/// Wait until at least 'k' Waitables of the range are ready, then
+/// dismiss the others. Set ready[i], resized to the range, for each
+/// ready Waitable and return their number.
+template<class CountdownLatch, class WaitableRange>
+auto wait_some_adl(CountdownLatch& latch, std::size_t k, std::vector<bool>& ready,
+                   WaitableRange&& events) ->
+    decltype(std::begin(events), std::end(events), std::size_t()) {
+    ready.assign(std::distance(std::begin(events), std::end(events)), false);
+    std::size_t count = 0;
+    details::latch_wait_some(latch, k, events, [&](std::size_t i) {
+            ready[i] = true;
+            ++count;
+        });
+    assert(count >= k);
+    return count;
 }
 
 template<class CountdownLatch, class... Waitable>
@@ -385,16 +590,194 @@ auto wait_all_adl(CountdownLatch& latch, Waitable&... e) ->
 
 template<class CountdownLatch, class... Waitable>
 auto wait_any_adl(CountdownLatch& latch, Waitable&... e) ->
-    void_t<decltype(get_event(e))...> {
+    decltype(void_t<decltype(get_event(e))...>(), std::size_t()) {
     event * events[] = {get_event(e)...};
     return wait_any_adl(latch, events);
 }
+
+/// Timed variants. Give up at 'deadline' and return
+/// future_status::timeout if the Waitables are not ready by then; the
+/// waits are dismissed, so the Waitables can be waited again later.
+///@{
+template<class CountdownLatch, class Waitable>
+auto wait_until_adl(CountdownLatch& latch, deadline_clock::time_point deadline,
+                    Waitable& e) ->
+    decltype(get_event(e), std::future_status()) {
+    latch.reset();
+    auto event = get_event(e);
+    if (!event->try_wait(&latch) || latch.wait_until(1, deadline))
+        return std::future_status::ready;
+    if (event->dismiss_wait(&latch))
+        return std::future_status::timeout;
+    // fired meanwhile, wait for the signal to be delivered
+    latch.wait(1);
+    return std::future_status::ready;
+}
+
+template<class CountdownLatch, class WaitableRange>
+auto wait_all_until_adl(CountdownLatch& latch, deadline_clock::time_point deadline,
+                        WaitableRange&& events) ->
+    decltype(std::begin(events), std::end(events), std::future_status()) {
+    latch.reset();
+    using event_type = range_event_t<WaitableRange>;
+    std::size_t waited = event_type::wait_many(
+        &latch, std::begin(events), std::end(events)).second;
+    if (!waited || latch.wait_until(waited, deadline))
+        return std::future_status::ready;
+    const std::size_t dismissed =
+        event_type::dismiss_wait_many(&latch, std::begin(events), std::end(events));
+    assert(dismissed <= waited);
+    if (waited != dismissed)
+        latch.wait(waited - dismissed);
+    return dismissed ? std::future_status::timeout : std::future_status::ready;
+}
+
+template<class CountdownLatch, class WaitableRange>
+auto wait_any_until_adl(CountdownLatch& latch, deadline_clock::time_point deadline,
+                        WaitableRange&& events) ->
+    decltype(std::begin(events), std::end(events), std::future_status()) {
+    latch.reset();
+    std::size_t signaled;
+    std::size_t waited;
+    using event_type = range_event_t<WaitableRange>;
+    std::tie(signaled, waited) =
+        event_type::wait_many(&latch, std::begin(events), std::end(events));
+    const bool woken = signaled == 0 && latch.wait_until(1, deadline);
+    const std::size_t dismissed =
+        event_type::dismiss_wait_many(&latch, std::begin(events), std::end(events));
+    assert(dismissed <= waited);
+    std::ptrdiff_t pending = waited - dismissed;
+    if (woken)
+        pending -= 1;
+    assert(pending >= 0);
+    if (pending)
+        latch.wait(pending);
+    return signaled || dismissed < waited ?
+        std::future_status::ready : std::future_status::timeout;
+}
+
+template<class CountdownLatch, class... Waitable>
+auto wait_all_until_adl(CountdownLatch& latch, deadline_clock::time_point deadline,
+                        Waitable&... e) ->
+    decltype(void_t<decltype(get_event(e))...>(), std::future_status()) {
+    event * events[] = {get_event(e)...};
+    return wait_all_until_adl(latch, deadline, events);
+}
+
+template<class CountdownLatch, class... Waitable>
+auto wait_any_until_adl(CountdownLatch& latch, deadline_clock::time_point deadline,
+                        Waitable&... e) ->
+    decltype(void_t<decltype(get_event(e))...>(), std::future_status()) {
+    event * events[] = {get_event(e)...};
+    return wait_any_until_adl(latch, deadline, events);
+}
+///@}
 /// @} 
 
 
 /// @} 
 
 
+/// Scope of a batch of signals, see signal_many. Waiters whose wake
+/// ups go through a shared target (e.g. the queue of a scheduler) can
+/// defer them to the end of the innermost batch, to issue one per
+/// target.
+struct signal_batch {
+    struct flusher {
+        virtual void flush() = 0;
+        flusher * next_flusher = 0;
+    protected:
+        ~flusher() {}
+    };
+
+    signal_batch() : outer(current()) { current() = this; }
+    signal_batch(const signal_batch&) = delete;
+    void operator=(const signal_batch&) = delete;
+
+    ~signal_batch() {
+        current() = outer;
+        flush();
+    }
+
+    /// Scope out of the batches of the thread, for a waiter which
+    /// switches to the waiting context from its notification: that
+    /// context must not see them. What they deferred so far is
+    /// flushed and they are inactive until the end of the scope.
+    struct pause {
+        pause() : batch(std::exchange(current(), nullptr)) {
+            for (auto b = batch; b; b = b->outer)
+                b->flush();
+        }
+        pause(const pause&) = delete;
+        void operator=(const pause&) = delete;
+        ~pause() { current() = batch; }
+    private:
+        signal_batch * batch;
+    };
+
+    /// The innermost batch of the thread, if any.
+    static signal_batch *& current() {
+        static thread_local signal_batch * batch = 0;
+        return batch;
+    }
+
+    /// Call f->flush() at the end of the batch.
+    void defer(flusher * f) {
+        f->next_flusher = flushers;
+        flushers = f;
+    }
+
+private:
+    void flush() {
+        while (auto f = flushers) {
+            flushers = f->next_flusher;
+            f->flush();
+        }
+    }
+
+    signal_batch * outer;
+    flusher * flushers = 0;
+};
+
+/// Signal each event of the range of event pointers [begin, end),
+/// within a signal_batch. The events are grouped by waiter and each
+/// of the first 'max_groups' distinct waiters is signaled once, via
+/// waiter::signal_many; the waiters beyond are signaled one event at
+/// a time. Every marked event is signaled, even if grouping it fails.
+template<class Iter>
+void signal_many(Iter begin, Iter end) {
+    enum { max_groups = 8 };
+    signal_batch batch;
+    waiter * waiters[max_groups];
+    std::vector<event_ptr> groups[max_groups];
+    std::size_t count = 0;
+    for (auto i = begin; i != end; ++i) {
+        auto w = (*i)->mark_signaled();
+        if (!w)
+            continue;
+        std::size_t g = 0;
+        while (g < count && waiters[g] != w)
+            ++g;
+        if (g == count) {
+            if (count == max_groups) {
+                w->notify(&**i);
+                continue;
+            }
+            waiters[count++] = w;
+        }
+        // The event is marked: it must reach its waiter, and not be
+        // deleted, if the group can't grow (the push has no effect
+        // then).
+        try {
+            groups[g].emplace_back(&**i);
+        } catch (...) {
+            w->notify(&**i);
+        }
+    }
+    for (std::size_t g = 0; g < count; ++g)
+        waiters[g]->signal_many(groups[g].data(), groups[g].size());
+}
+
 /// Wait entry points; simply defer to the customization points
 /// @{
 template<class WaitStrategy, class Waitable>
@@ -407,9 +790,81 @@ void wait_all(WaitStrategy& how, Waitable&... w) noexcept {
     wait_all_adl(how, w...);
 }
 
+/// Return the index of a ready Waitable: the first one, in argument
+/// order or, for a single range, in range order.
 template<class WaitStrategy, class... Waitable>
-void wait_any(WaitStrategy& to, Waitable&... w) noexcept {
-    wait_any_adl(to, w...);
+std::size_t wait_any(WaitStrategy& to, Waitable&... w) noexcept {
+    return wait_any_adl(to, w...);
+}
+
+/// As wait_any on a range; set ready[i], resized to the range, for
+/// each ready Waitable and return their number.
+template<class WaitStrategy, class WaitableRange>
+std::size_t wait_any_ready(WaitStrategy& to, std::vector<bool>& ready,
+                           WaitableRange&& events) noexcept {
+    return wait_any_ready_adl(to, ready, events);
+}
+
+/// Wait until at least 'k' Waitables of the range are ready, e.g. the
+/// first k of n replicas, and stop waiting for the others: the wait
+/// takes as long as the k-th fastest. Set ready[i], resized to the
+/// range, for each ready Waitable and return their number.
+///
+/// Pre: the range has at least 'k' Waitables with an event.
+template<class WaitStrategy, class WaitableRange>
+std::size_t wait_some(WaitStrategy& how, std::size_t k, std::vector<bool>& ready,
+                      WaitableRange&& events) noexcept {
+    return wait_some_adl(how, k, ready, events);
+}
+
+template<class WaitStrategy, class WaitableRange>
+std::size_t wait_some(WaitStrategy& how, std::size_t k, WaitableRange&& events) noexcept {
+    std::vector<bool> ready;
+    return wait_some_adl(how, k, ready, events);
+}
+
+/// Timed waits, the deadline of any clock or the timeout comes before
+/// the Waitables.
+template<class WaitStrategy, class Clock, class Duration, class Waitable>
+std::future_status
+wait_until(WaitStrategy& how, const std::chrono::time_point<Clock, Duration>& deadline,
+           Waitable& w) noexcept {
+    return wait_until_adl(how, details::to_deadline(deadline), w);
+}
+
+template<class WaitStrategy, class Rep, class Period, class Waitable>
+std::future_status
+wait_for(WaitStrategy& how, const std::chrono::duration<Rep, Period>& timeout,
+         Waitable& w) noexcept {
+    return wait_until_adl(how, details::deadline_after(timeout), w);
+}
+
+template<class WaitStrategy, class Clock, class Duration, class... Waitable>
+std::future_status
+wait_all_until(WaitStrategy& how, const std::chrono::time_point<Clock, Duration>& deadline,
+               Waitable&... w) noexcept {
+    return wait_all_until_adl(how, details::to_deadline(deadline), w...);
+}
+
+template<class WaitStrategy, class Rep, class Period, class... Waitable>
+std::future_status
+wait_all_for(WaitStrategy& how, const std::chrono::duration<Rep, Period>& timeout,
+             Waitable&... w) noexcept {
+    return wait_all_until_adl(how, details::deadline_after(timeout), w...);
+}
+
+template<class WaitStrategy, class Clock, class Duration, class... Waitable>
+std::future_status
+wait_any_until(WaitStrategy& to, const std::chrono::time_point<Clock, Duration>& deadline,
+               Waitable&... w) noexcept {
+    return wait_any_until_adl(to, details::to_deadline(deadline), w...);
+}
+
+template<class WaitStrategy, class Rep, class Period, class... Waitable>
+std::future_status
+wait_any_for(WaitStrategy& to, const std::chrono::duration<Rep, Period>& timeout,
+             Waitable&... w) noexcept {
+    return wait_any_until_adl(to, details::deadline_after(timeout), w...);
 }
 
 /// @}
@@ -1,13 +1,14 @@
 #ifndef GPD_FD_WAITER_HPP
 #define GPD_FD_WAITER_HPP
 #include "event.hpp"
+#include "details/deadline.hpp"
 #include <sys/eventfd.h>
 #include <unistd.h> // read/write
 #include <poll.h>   
 namespace gpd {
 
 // eventfd based waiter
-struct fd_waiter : waiter {
+struct fd_waiter : direct_waiter<fd_waiter> {
     int fd;
     
     fd_waiter() : fd( ::eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK )) {
@@ -20,44 +21,85 @@ struct fd_waiter : waiter {
         signal_counter.store(0, std::memory_order_relaxed);
     }
     
-    void signal(event_ptr p) override {
-        p.release();
-        std::uint64_t buf = 1;
+    void on_signal(event_base *) {
         auto v = --signal_counter;
         if (v == 0)
-            while(true) {
-                auto ret = ::write(fd, &buf, sizeof(buf));
-                if (ret == -1) {
-                    assert(errno == EINTR);
-                    continue;
-                }
-                assert(ret == 8);
-                break;
-            }
+            wake();
+    }
+
+    void signal_many(event_ptr * ps, std::size_t n) override {
+        for (std::size_t i = 0; i < n; ++i)
+            ps[i].release();
+        std::int32_t count = n;
+        auto old = signal_counter.fetch_sub(count);
+        if (old > 0 && old <= count)
+            wake();
     }
         
     void wait(std::size_t count = 1) {
-        std::uint64_t buf = 0;
         auto v = signal_counter += count;
         if (v > 0)
-            while(true)  {
-                auto ret = ::read(fd, &buf, sizeof(buf));
-                if (ret == -1)
-                    switch(errno) {
-                    case EINTR: continue;
-                    case EAGAIN: { //
-                        ::pollfd fds[1] = { { fd,POLLIN, 0 } };
-                        ::poll(fds, 1, -1);
-                        continue;
-                    }
-                    default: assert(false);
-                    }
-                assert(ret == 8);
-                break;
-            }
+            take(nullptr);
+    }
+
+    /// As wait, but give up at 'deadline': the count is restored and
+    /// false returned.
+    bool wait_until(std::size_t count, deadline_clock::time_point deadline) {
+        std::int32_t n = count;
+        auto v = signal_counter += n;
+        if (v <= 0 || take(&deadline))
+            return true;
+        // withdraw, unless the last signal got there first and is
+        // writing
+        v = signal_counter.load();
+        while (v > 0)
+            if (signal_counter.compare_exchange_weak(v, v - n))
+                return false;
+        take(nullptr);
+        return true;
     }
 
     ~fd_waiter() { ::close(fd); }
+
+private:
+    void wake() {
+        std::uint64_t buf = 1;
+        while(true) {
+            auto ret = ::write(fd, &buf, sizeof(buf));
+            if (ret == -1) {
+                assert(errno == EINTR);
+                continue;
+            }
+            assert(ret == 8);
+            break;
+        }
+    }
+
+    bool take(const deadline_clock::time_point * deadline) {
+        std::uint64_t buf = 0;
+        while(true)  {
+            auto ret = ::read(fd, &buf, sizeof(buf));
+            if (ret == -1)
+                switch(errno) {
+                case EINTR: continue;
+                case EAGAIN: { //
+                    ::pollfd fds[1] = { { fd,POLLIN, 0 } };
+                    if (!deadline)
+                        ::poll(fds, 1, -1);
+                    else if (deadline_clock::now() >= *deadline)
+                        return false;
+                    else {
+                        auto ts = details::time_left(*deadline);
+                        ::ppoll(fds, 1, &ts, 0);
+                    }
+                    continue;
+                }
+                default: assert(false);
+                }
+            assert(ret == 8);
+            return true;
+        }
+    }
 };
 
 
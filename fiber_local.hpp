@@ -0,0 +1,62 @@
+#ifndef GPD_FIBER_LOCAL_HPP
+#define GPD_FIBER_LOCAL_HPP
+#include "details/fiber_storage.hpp"
+
+#ifndef GPD_FIBER_LOCAL
+#error "fiber_local requires GPD_FIBER_LOCAL, defined in all translation units"
+#endif
+
+namespace gpd {
+
+/**
+ * A variable with a distinct instance per execution context: each
+ * continuation (and so each task), each pooled fiber job and each
+ * stackless task sees its own instance, which follows it when it
+ * migrates between threads, e.g. via yield(scheduler&). Code running
+ * outside of any context sees a per thread instance.
+ *
+ * The instance is created on first access in the context, either
+ * value initialized or from 'init', and destroyed when the context
+ * finishes. Access is a lookup in a small slot array, with no
+ * hashing or locking.
+ *
+ * Each fiber_local takes a slot for the life of the program, so they
+ * are meant to be objects with static storage duration; at most
+ * GPD_FIBER_LOCAL_SLOTS can be created.
+ *
+ * NOTE: a function run on top of a context via callcc(c, f) sees the
+ * instances of the interrupting context.
+ *
+ * NOTE: requires GPD_FIBER_LOCAL to be defined in all translation
+ * units, as it adds a save and restore of the storage to every switch.
+ */
+template<class T>
+struct fiber_local {
+    fiber_local()
+        : index(details::fiber_storage::allocate_slot(&destroy)), init(0) {}
+
+    explicit fiber_local(T (*init)())
+        : index(details::fiber_storage::allocate_slot(&destroy)), init(init) {}
+
+    fiber_local(const fiber_local&) = delete;
+
+    /// The instance of the running context.
+    T& get() const {
+        auto& storage = details::fiber_storage::current();
+        if (__builtin_expect(!storage.has(index), false))
+            storage.set(index, init ? new T(init()) : new T());
+        return *static_cast<T*>(storage.get(index));
+    }
+
+    T& operator*() const { return get(); }
+    T* operator->() const { return &get(); }
+
+private:
+    static void destroy(void * p) { delete static_cast<T*>(p); }
+
+    std::size_t index;
+    T (*init)();
+};
+
+}
+#endif
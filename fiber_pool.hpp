@@ -0,0 +1,218 @@
+#ifndef GPD_FIBER_POOL_HPP
+#define GPD_FIBER_POOL_HPP
+#include "continuation.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+namespace gpd {
+
+namespace details {
+
+// A functor to run on a pooled fiber. It lives on the stack of the
+// requester until the fiber has moved it onto its own stack.
+struct fiber_job {
+    // Run the job; return the continuation to switch to when it is
+    // done, and store in 'excp' the exception to propagate to it.
+    switch_pair (*run)(fiber_job * job, switch_pair from, std::exception_ptr& excp);
+    void * functor;
+};
+
+template<class Continuation, class F>
+switch_pair run_fiber_job(fiber_job * job, switch_pair from,
+                          std::exception_ptr& excp) {
+    try {
+        fiber_storage_scope fls(true);
+        F f(std::move(*static_cast<F*>(job->functor)));
+        return do_call(f, Continuation(from));
+    } catch(abnormal_exit_exception& e) {
+        excp = e.nested_ptr();
+        return switch_pair{ details::switch_pair_accessor::pilfer(e).sp, 0 };
+    } catch(exit_exception& e) {
+        return switch_pair{ details::switch_pair_accessor::pilfer(e).sp, 0 };
+    }
+}
+
+struct fiber_park_args {
+    void (*park)(void * pool, cont fiber);
+    void * pool;
+    std::exception_ptr excp;
+};
+
+// Executed on top of the target of a finished job: give back the
+// fiber to the pool. From here on the fiber may be re-armed by other
+// threads, so 'args', which lives on the fiber stack, is not touched
+// after the park.
+inline switch_pair fiber_park_trampoline(parm_t arg, cont fiber) {
+    auto argsp = static_cast<fiber_park_args*>(arg);
+    auto excp = std::move(argsp->excp);
+    argsp->park(argsp->pool, fiber);
+    if (excp) std::rethrow_exception(excp);
+    return switch_pair{{0}, 0};
+}
+
+// Body of a pooled fiber: run jobs until resumed with a null one.
+struct fiber_main {
+    void (*park)(void * pool, cont fiber);
+    void * pool;
+
+    continuation<void()> operator()(continuation<void()> c) {
+        switch_pair from = details::switch_pair_accessor::pilfer(c);
+        while (auto job = static_cast<fiber_job*>(from.parm)) {
+            fiber_park_args args { park, pool, nullptr };
+            switch_pair to = job->run(job, switch_pair{ from.sp, 0 }, args.excp);
+            assert(to.sp && "invalid target stack");
+            from = execute_into(&args, to.sp, &fiber_park_trampoline);
+        }
+        return continuation<void()>(switch_pair{ from.sp, 0 });
+    }
+};
+}
+
+/**
+ * A pool of reusable fibers.
+ *
+ * pool.callcc(f) behaves as callcc(f), but runs 'f' on an idle fiber
+ * of the pool if any. When 'f' returns, instead of destroying its
+ * stack, the fiber goes back to the pool, ready to be re-armed with
+ * the next functor: no stack allocation or trampoline setup is done
+ * on the hot path. New fibers are created as deferred-start
+ * continuations; fibers finishing when the pool already holds
+ * 'max_idle' of them are destroyed.
+ *
+ * The pool is thread safe: fibers can finish on any thread.
+ *
+ * Destruction waits for the fibers whose job has returned to get back
+ * to the pool, e.g. after the futures of async(sched, pool, f) are
+ * ready; no job of the pool must be running or suspended otherwise,
+ * which is asserted when no fiber comes back for 10 seconds. The
+ * wait blocks the thread: from a task of a scheduler, all the jobs
+ * which run on that scheduler must have returned already.
+ */
+template<class StackAlloc = default_stack_allocator>
+struct fiber_pool {
+    explicit fiber_pool(std::size_t max_idle = 64,
+                        stack_size_t size = { StackAlloc::stack_size })
+        : max_idle(max_idle), size(size.size) {}
+
+    fiber_pool(const fiber_pool&) = delete;
+
+    ~fiber_pool() {
+        std::unique_lock<std::mutex> lock(mux);
+        draining = true;
+        while (fibers) {
+            if (idle.empty()) {
+                const bool back = returned.wait_for(
+                    lock, std::chrono::seconds(10),
+                    [this] { return !idle.empty() || !fibers; });
+                assert(back && "fiber_pool destroyed with a job suspended");
+                (void)back;
+                continue;
+            }
+            cont fiber = idle.back();
+            idle.pop_back();
+            lock.unlock();
+            destroy(fiber);
+            lock.lock();
+        }
+    }
+
+    template<class F,
+             class... Args,
+             class Sig = typename details::deduce_signature<F>::type>
+    continuation<Sig> callcc(F f, Args&&... args) {
+        return spawn<Sig>(gpd::bind(std::move(f), placeholder<0>(),
+                                    std::forward<Args>(args)...));
+    }
+
+    template<class Sig,
+             class F,
+             class... Args>
+    continuation<Sig> callcc(F f, Args&&... args) {
+        return spawn<Sig>(gpd::bind(std::move(f), placeholder<0>(),
+                                    std::forward<Args>(args)...));
+    }
+
+    /// Number of idle fibers.
+    std::size_t idle_count() {
+        std::lock_guard<std::mutex> _(mux);
+        return idle.size();
+    }
+
+    /// Destroy all but 'keep' idle fibers.
+    void trim(std::size_t keep) {
+        std::vector<cont> excess;
+        {
+            std::lock_guard<std::mutex> _(mux);
+            while (idle.size() > keep) {
+                excess.push_back(idle.back());
+                idle.pop_back();
+            }
+        }
+        for (auto fiber : excess)
+            destroy(fiber);
+    }
+
+private:
+    template<class Sig, class F>
+    continuation<Sig> spawn(F f) {
+        typedef typename continuation<Sig>::rsignature rsignature;
+        details::fiber_job job {
+            &details::run_fiber_job<continuation<rsignature>, F>, &f };
+        return continuation<Sig>(stack_switch(pop(), &job));
+    }
+
+    cont pop() {
+        {
+            std::lock_guard<std::mutex> _(mux);
+            if (!idle.empty()) {
+                cont fiber = idle.back();
+                idle.pop_back();
+                return fiber;
+            }
+            ++fibers;
+        }
+        return details::switch_pair_accessor::pilfer(
+            details::create_deferred_continuation<void()>(
+                details::fiber_main{ &fiber_pool::park, this },
+                StackAlloc(), size)).sp;
+    }
+
+    static void park(void * pool, cont fiber) {
+        auto self = static_cast<fiber_pool*>(pool);
+        {
+            std::lock_guard<std::mutex> _(self->mux);
+            if (self->idle.size() < self->max_idle) {
+                self->idle.push_back(fiber);
+                if (self->draining)
+                    self->returned.notify_all();
+                return;
+            }
+        }
+        self->destroy(fiber);
+    }
+
+    // The pool may be destroyed as soon as the count is updated.
+    void destroy(cont fiber) {
+        auto r = stack_switch(fiber, nullptr);
+        assert(!r.sp); (void)r;
+        std::lock_guard<std::mutex> _(mux);
+        --fibers;
+        if (draining)
+            returned.notify_all();
+    }
+
+    std::mutex mux;
+    std::condition_variable returned; // signaled while draining
+    bool draining = false;            // set by the destructor
+    std::vector<cont> idle;
+    std::size_t fibers = 0; // created and not yet destroyed
+    std::size_t max_idle;
+    std::size_t size;
+};
+
+}
+#endif
@@ -9,7 +9,9 @@
 #include <sys/syscall.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <time.h>
 #include <atomic>
+#include <cassert>
 
 namespace gpd {
 namespace details {
@@ -17,6 +19,35 @@ inline long sys_futex(void *addr1, int op, int val1,
                       struct timespec *timeout, void *addr2, int val3) {
 	return syscall(SYS_futex, addr1, op, val1, timeout, addr2, val3);
 }
+
+#ifndef SYS_futex_waitv
+#define SYS_futex_waitv 449
+#endif
+
+/// Element of the futex_waitv array, as struct futex_waitv of newer
+/// kernel headers.
+struct futex_waitv_t {
+    uint64_t val;
+    uint64_t uaddr;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+enum { futex_waitv_max = 128, futex_waitv_size32 = 2 };
+
+/// Wait on any of 'n' futexes until an absolute 'timeout' of
+/// 'clockid', if not null. Linux 5.16+.
+inline long sys_futex_waitv(futex_waitv_t * waiters, unsigned n,
+                            struct timespec * timeout, clockid_t clockid) {
+    return syscall(SYS_futex_waitv, waiters, n, 0, timeout, clockid);
+}
+}
+
+/// Whether the running kernel supports futex_waitv.
+inline bool futex_waitv_available() {
+    static const bool available =
+        details::sys_futex_waitv(0, 0, 0, CLOCK_MONOTONIC) == -1 && errno == EINVAL;
+    return available;
 }
 
 /**
@@ -2,32 +2,134 @@
 #define GPD_FUTEX_WAITER_HPP
 #include "event.hpp"
 #include "futex.hpp"
+#include "details/deadline.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <thread>
 namespace gpd {
-// Futex based one shot binary semaphore. Not fast pathed.
-struct futex_waiter : waiter {
-    futex signal_counter = { 0 };
+
+/// Spin policy of futex_waiter: park right away.
+struct no_spin {
+    std::uint64_t budget() const { return 0; }
+    void record(std::uint64_t) {}
+};
+
+/**
+ * Spin policy of adaptive_waiter: spin for up to twice the average
+ * duration, in TSC cycles, of the recent waits of the thread, as long
+ * as that is cheaper than parking and waking it. Long waits disable
+ * spinning until shorter ones bring the average down again. Never
+ * spins on a single CPU.
+ */
+struct adaptive_spin {
+    /// About the cost of a futex sleep and wake up.
+    static constexpr std::uint64_t max_spin = 20000;
+
+    std::uint64_t budget() const {
+        static const bool multicore = std::thread::hardware_concurrency() > 1;
+        std::uint64_t a = average();
+        return multicore && 2 * a <= max_spin ? 2 * a : 0;
+    }
+
+    void record(std::uint64_t cycles) {
+        auto& a = average();
+        a = a - a / 8 + std::min<std::uint64_t>(cycles, 2 * max_spin) / 8;
+    }
+
+private:
+    static std::uint64_t& average() {
+        static thread_local std::uint64_t a = max_spin / 4;
+        return a;
+    }
+};
+
+/**
+ * Futex based countdown latch. 'signal' only issues FUTEX_WAKE if
+ * the waiting thread is parked; 'wait' first spins as long as
+ * 'SpinPolicy' allows.
+ */
+template<class SpinPolicy>
+struct basic_futex_waiter : direct_waiter<basic_futex_waiter<SpinPolicy> > {
+    /// twice the pending count, plus the parked bit
+    futex state = { 0 };
+    SpinPolicy spin;
 
     void reset() {
-        signal_counter.store(0, std::memory_order_relaxed);
-    }    
-
-    void signal(event_ptr p) override {
-        p.release();
-        auto v = --signal_counter;
-        if (v == 0)
-            signal_counter.signal();
-    }
-    
-    void  wait(std::size_t count = 1)   {
-        auto v = signal_counter += count;
-        while (v > 0) {
-            signal_counter.wait(v);
-            v = signal_counter.load(std::memory_order_relaxed);
-        }
+        state.store(0, std::memory_order_relaxed);
     }
 
+    void on_signal(event_base *) {
+        // the waiter may be gone as soon as the count drops to zero
+        auto old = state.fetch_sub(2);
+        if ((old >> 1) == 1 && (old & parked))
+            state.signal();
+    }
+
+    void signal_many(event_ptr * ps, std::size_t n) override {
+        for (std::size_t i = 0; i < n; ++i)
+            ps[i].release();
+        int count = n;
+        auto old = state.fetch_sub(2 * count);
+        if ((old >> 1) > 0 && (old >> 1) <= count && (old & parked))
+            state.signal();
+    }
+
+    void wait(std::size_t count = 1)   {
+        wait_impl(count, nullptr);
+    }
+
+    /// As wait, but give up at 'deadline': the count is restored and
+    /// false returned.
+    bool wait_until(std::size_t count, deadline_clock::time_point deadline) {
+        return wait_impl(count, &deadline);
+    }
+
+private:
+    enum { parked = 1 };
+    static bool done(int v) { return (v >> 1) <= 0; }
+
+    bool wait_impl(std::size_t count, const deadline_clock::time_point * deadline) {
+        int n = 2 * count;
+        int v = state.fetch_add(n) + n;
+        if (done(v))
+            return true;
+        auto start = __builtin_ia32_rdtsc();
+        if (auto budget = spin.budget())
+            while (__builtin_ia32_rdtsc() - start < budget) {
+                __builtin_ia32_pause();
+                if (done(state.load(std::memory_order_acquire))) {
+                    spin.record(__builtin_ia32_rdtsc() - start);
+                    return true;
+                }
+            }
+        while (true) {
+            v = state.load(std::memory_order_acquire);
+            if (done(v))
+                break;
+            if (deadline && deadline_clock::now() >= *deadline) {
+                // withdraw, unless the last signal gets there first
+                if (state.compare_exchange_weak(v, (v - n) & ~parked))
+                    return false;
+                continue;
+            }
+            if (!(v & parked) && !state.compare_exchange_weak(v, v | parked))
+                continue;
+            if (deadline)
+                state.wait(v | parked, details::time_left(*deadline));
+            else
+                state.wait(v | parked);
+        }
+        state.fetch_and(~parked, std::memory_order_relaxed);
+        spin.record(__builtin_ia32_rdtsc() - start);
+        return true;
+    }
 };
 
+// Futex based waiter, parks without spinning.
+using futex_waiter = basic_futex_waiter<no_spin>;
+
+// Spin-then-park waiter, the default waiter of future::get.
+using adaptive_waiter = basic_futex_waiter<adaptive_spin>;
 
 }
 #endif
@@ -0,0 +1,214 @@
+#ifndef GPD_FUTEXV_WAITER_HPP
+#define GPD_FUTEXV_WAITER_HPP
+#include "event.hpp"
+#include "futex.hpp"
+#include "futex_waiter.hpp"
+#include "details/deadline.hpp"
+#include <climits>
+#include <cstdint>
+#include <type_traits>
+namespace gpd {
+
+/**
+ * Thread wait strategy whose wait_any sleeps directly on the words of
+ * the events with futex_waitv (Linux 5.16+), instead of registering a
+ * countdown latch with every event: the events only share a static
+ * waiter that wakes the thread sleeping on the signaled event.
+ *
+ * The kernel queues the thread on every futex, so sleeping costs
+ * grow with the number of events faster than with the latch (see
+ * wait_any_benchmark_test); prefer futex_waiter for wide sets.
+ *
+ * Falls back to 'fallback' when the kernel lacks futex_waitv, for
+ * more than futex_waitv_max events, for event implementations other
+ * than the wait-free one and for wait, wait_all and wait_some.
+ */
+struct futexv_waiter {
+    futex_waiter fallback;
+};
+
+namespace details {
+
+/// The waiter futexv_waiter registers with the events. It wakes the
+/// thread sleeping on the event, without touching the event, which
+/// may already be gone by then (a stale wake up is harmless).
+struct futexv_wake_t : direct_waiter<futexv_wake_t> {
+    void on_signal(event_base * p) {
+        auto e = static_cast<basic_event<waitfree_event_policy>*>(p);
+        sys_futex(e->futex_word(), FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+    }
+};
+
+inline waiter * futexv_wake() {
+    static futexv_wake_t w;
+    return &w;
+}
+
+template<class WaitableRange, class F>
+bool futexv_wait_any(WaitableRange&, const deadline_clock::time_point *,
+                     std::future_status&, F&&, std::false_type) {
+    return false;
+}
+
+/// wait_any on the event words, calling ready(i) for each ready i-th
+/// event of the range. Return false, without waiting, if not
+/// applicable.
+template<class WaitableRange, class F>
+bool futexv_wait_any(WaitableRange& events, const deadline_clock::time_point * deadline,
+                     std::future_status& status, F&& ready, std::true_type) {
+    using event_type = basic_event<waitfree_event_policy>;
+    if (!futex_waitv_available())
+        return false;
+    const std::uint32_t waited_value =
+        std::uint32_t(reinterpret_cast<std::uintptr_t>(futexv_wake()));
+    futex_waitv_t words[futex_waitv_max];
+    unsigned n = 0;
+    for (auto i = std::begin(events); i != std::end(events); ++i)
+        if (auto e = get_event(*i)) {
+            if (n == futex_waitv_max)
+                return false;
+            words[n++] = { waited_value,
+                           reinterpret_cast<std::uintptr_t>(e->futex_word()),
+                           futex_waitv_size32 | FUTEX_PRIVATE_FLAG, 0 };
+        }
+    timespec ts = deadline ? to_timespec(deadline->time_since_epoch()) : timespec();
+    while (true) {
+        std::size_t signaled;
+        std::size_t waited;
+        std::tie(signaled, waited) =
+            event_type::wait_many(futexv_wake(), std::begin(events), std::end(events));
+        bool timed_out = false;
+        // a changed word (EAGAIN) is a signaled event
+        if (signaled == 0)
+            while (sys_futex_waitv(words, n, deadline ? &ts : 0, CLOCK_MONOTONIC) == -1 &&
+                   errno != EAGAIN) {
+                if (errno == ETIMEDOUT) {
+                    timed_out = true;
+                    break;
+                }
+                assert(errno == EINTR);
+            }
+        const std::size_t dismissed =
+            event_type::dismiss_wait_many(futexv_wake(), std::begin(events), std::end(events),
+                                          ready);
+        assert(dismissed <= waited);
+        if (signaled || dismissed < waited) {
+            status = std::future_status::ready;
+            return true;
+        }
+        if (timed_out) {
+            status = std::future_status::timeout;
+            return true;
+        }
+        // spurious wake up
+    }
+}
+
+template<class WaitableRange>
+using is_futexv_range = std::is_same<range_event_t<WaitableRange>,
+                                     basic_event<waitfree_event_policy> >;
+}
+
+/// futexv_waiter customization points
+///@{
+template<class Waitable>
+auto wait_adl(futexv_waiter& w, Waitable& e) ->
+    void_t<decltype(get_event(e))> {
+    wait_adl(w.fallback, e);
+}
+
+template<class WaitableRange>
+auto wait_all_adl(futexv_waiter& w, WaitableRange&& events) ->
+    void_t<decltype(std::begin(events)), decltype(std::end(events))> {
+    wait_all_adl(w.fallback, events);
+}
+
+template<class WaitableRange>
+auto wait_any_adl(futexv_waiter& w, WaitableRange&& events) ->
+    decltype(std::begin(events), std::end(events), std::size_t()) {
+    std::future_status status;
+    std::size_t first = std::size_t(-1);
+    if (!details::futexv_wait_any(events, nullptr, status,
+                                  [&](std::size_t i) { if (i < first) first = i; },
+                                  details::is_futexv_range<WaitableRange>()))
+        return wait_any_adl(w.fallback, events);
+    return first;
+}
+
+template<class WaitableRange>
+auto wait_any_ready_adl(futexv_waiter& w, std::vector<bool>& ready,
+                        WaitableRange&& events) ->
+    decltype(std::begin(events), std::end(events), std::size_t()) {
+    std::future_status status;
+    std::size_t count = 0;
+    ready.assign(std::distance(std::begin(events), std::end(events)), false);
+    if (!details::futexv_wait_any(events, nullptr, status,
+                                  [&](std::size_t i) { ready[i] = true; ++count; },
+                                  details::is_futexv_range<WaitableRange>()))
+        return wait_any_ready_adl(w.fallback, ready, events);
+    return count;
+}
+
+template<class WaitableRange>
+auto wait_some_adl(futexv_waiter& w, std::size_t k, std::vector<bool>& ready,
+                   WaitableRange&& events) ->
+    decltype(std::begin(events), std::end(events), std::size_t()) {
+    return wait_some_adl(w.fallback, k, ready, events);
+}
+
+template<class... Waitable>
+auto wait_all_adl(futexv_waiter& w, Waitable&... e) ->
+    void_t<decltype(get_event(e))...> {
+    wait_all_adl(w.fallback, e...);
+}
+
+template<class... Waitable>
+auto wait_any_adl(futexv_waiter& w, Waitable&... e) ->
+    decltype(void_t<decltype(get_event(e))...>(), std::size_t()) {
+    event * events[] = {get_event(e)...};
+    return wait_any_adl(w, events);
+}
+
+template<class Waitable>
+auto wait_until_adl(futexv_waiter& w, deadline_clock::time_point deadline,
+                    Waitable& e) ->
+    decltype(get_event(e), std::future_status()) {
+    return wait_until_adl(w.fallback, deadline, e);
+}
+
+template<class WaitableRange>
+auto wait_all_until_adl(futexv_waiter& w, deadline_clock::time_point deadline,
+                        WaitableRange&& events) ->
+    decltype(std::begin(events), std::end(events), std::future_status()) {
+    return wait_all_until_adl(w.fallback, deadline, events);
+}
+
+template<class WaitableRange>
+auto wait_any_until_adl(futexv_waiter& w, deadline_clock::time_point deadline,
+                        WaitableRange&& events) ->
+    decltype(std::begin(events), std::end(events), std::future_status()) {
+    std::future_status status;
+    if (details::futexv_wait_any(events, &deadline, status, [](std::size_t) {},
+                                 details::is_futexv_range<WaitableRange>()))
+        return status;
+    return wait_any_until_adl(w.fallback, deadline, events);
+}
+
+template<class... Waitable>
+auto wait_all_until_adl(futexv_waiter& w, deadline_clock::time_point deadline,
+                        Waitable&... e) ->
+    decltype(void_t<decltype(get_event(e))...>(), std::future_status()) {
+    return wait_all_until_adl(w.fallback, deadline, e...);
+}
+
+template<class... Waitable>
+auto wait_any_until_adl(futexv_waiter& w, deadline_clock::time_point deadline,
+                        Waitable&... e) ->
+    decltype(void_t<decltype(get_event(e))...>(), std::future_status()) {
+    event * events[] = {get_event(e)...};
+    return wait_any_until_adl(w, deadline, events);
+}
+///@}
+
+}
+#endif
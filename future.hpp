@@ -5,8 +5,11 @@
 #include <cassert>
 #include <deque>
 #include <thread>
+#include <utility>
+#include <vector>
 #include "event.hpp"
-#include "cv_waiter.hpp" // default waiter
+#include "cv_waiter.hpp"
+#include "futex_waiter.hpp" // default waiter
 namespace gpd {
 
 
@@ -141,7 +144,7 @@ public:
 
     shared_state * steal() { return std::exchange(state, nullptr); }
 public:
-    using default_waiter = cv_waiter;
+    using default_waiter = adaptive_waiter;
     // a ready future
     future(T value) : state(new shared_state{std::move(value)}) {}
     future() : state(0) {}
@@ -175,6 +178,26 @@ public:
             wait(strategy, *this);
     }
 
+    /// As wait, but give up after 'timeout'.
+    template<class Rep, class Period, class WaitStrategy=default_waiter>
+    std::future_status wait_for(const std::chrono::duration<Rep, Period>& timeout,
+                                WaitStrategy&& strategy=WaitStrategy{}) {
+        using gpd::wait_for;
+        assert(valid());
+        return ready() ? std::future_status::ready
+            : wait_for(strategy, timeout, *this);
+    }
+
+    /// As wait, but give up at 'deadline'.
+    template<class Clock, class Duration, class WaitStrategy=default_waiter>
+    std::future_status wait_until(const std::chrono::time_point<Clock, Duration>& deadline,
+                                  WaitStrategy&& strategy=WaitStrategy{}) {
+        using gpd::wait_until;
+        assert(valid());
+        return ready() ? std::future_status::ready
+            : wait_until(strategy, deadline, *this);
+    }
+
     template<class F>
     auto then(F&&f) {
         return gpd::then(std::move(*this), std::forward<F>(f));
@@ -203,13 +226,7 @@ public:
     
     void set_value(T x) {
         //std::cerr << "set_value: " << ::pthread_self() << ' ' << this << ' ' << state << '\n';
-        // we can't distinguish the ''no state'' state
-        if (!state)
-            throw std::future_error (std::future_errc::promise_already_satisfied);
-
-        auto tstate = std::exchange(state, nullptr);
-        tstate->set_value(std::move(x));
-        tstate->signal();
+        fulfil(std::move(x))->signal();
     }
     
     template<class E>
@@ -227,9 +244,42 @@ public:
             set_exception(std::future_error(std::future_errc::broken_promise));
     }
 private:
+    template<class PromiseIter, class ValueIter>
+    friend void set_values(PromiseIter first, PromiseIter last, ValueIter values);
+
+    // set_value, except for the signal
+    shared_state * fulfil(T x) {
+        // we can't distinguish the ''no state'' state
+        if (!state)
+            throw std::future_error (std::future_errc::promise_already_satisfied);
+
+        auto tstate = std::exchange(state, nullptr);
+        tstate->set_value(std::move(x));
+        return tstate;
+    }
+
     shared_state * state;
 };
 
+/// Set the value of each promise in the forward range [first, last)
+/// to the matching element of the range starting at 'values' (moved
+/// from), then signal them all with signal_many: each distinct waiter
+/// is woken once.
+template<class PromiseIter, class ValueIter>
+void set_values(PromiseIter first, PromiseIter last, ValueIter values) {
+    using promise_type = typename std::iterator_traits<PromiseIter>::value_type;
+    std::vector<typename promise_type::shared_state*> states;
+    states.reserve(std::distance(first, last));
+    try {
+        for (; first != last; ++first, ++values)
+            states.push_back(first->fulfil(std::move(*values)));
+    } catch (...) {
+        signal_many(states.begin(), states.end());
+        throw;
+    }
+    signal_many(states.begin(), states.end());
+}
+
 
 template<class F>
 auto async(F&& f)
@@ -250,13 +300,12 @@ template<class Waitable, class F>
 auto then(Waitable w, F&& f)
 {
     using T = decltype(f(std::move(w)));
-    struct state : waiter, shared_state<T> {
+    struct state : direct_waiter<state>, shared_state<T> {
         state(Waitable&& w, F&& f)
             : w(std::move(w)), f(std::forward<F>(f)){}
         Waitable w;
         std::decay_t<F> f;
-        void signal(event_ptr p) override {
-            p.release();
+        void on_signal(event_base *) {
             eval_into(*this, f, std::move(w));
             shared_state<T>::signal();
         }
@@ -271,6 +320,74 @@ auto then(Waitable w, F&& f)
     return future<T>(p.release());
 }
 
+/// Result of when_some: all the futures, and the indexes of those
+/// found ready, in order.
+template<class Future>
+struct when_some_result {
+    std::vector<std::size_t> indexes;
+    std::vector<Future> futures;
+};
+
+/// Return a future which becomes ready as soon as at least 'k' of
+/// 'futures' are ready; the others are no longer waited and can
+/// simply be dropped with the result.
+///
+/// The state waits on all the events, like a countdown latch: the
+/// k-th signal dismisses the rest, and the result is set once the
+/// signals which raced with the dismissal have been delivered.
+///
+/// Pre: at least 'k' of 'futures' are valid.
+template<class Future>
+future<when_some_result<Future> > when_some(std::size_t k, std::vector<Future> futures)
+{
+    using T = when_some_result<Future>;
+    struct state : direct_waiter<state>, shared_state<T> {
+        state(std::vector<Future>&& futures) : futures(std::move(futures)) {}
+        std::vector<Future> futures;
+        std::vector<std::size_t> indexes;
+        std::size_t waited = 0;
+        // signals to go until the k-th, and signals not delivered yet
+        std::atomic<std::ptrdiff_t> count = { 0 };
+        std::atomic<std::ptrdiff_t> pending = { 0 };
+
+        void on_signal(event_base *) {
+            if (--count == 0)
+                fire();
+            if (--pending == 0)
+                complete();
+        }
+
+        void wait(std::size_t needed) {
+            if ((count += needed) <= 0)
+                fire();
+        }
+
+        void fire() {
+            using event_type = range_event_t<std::vector<Future> >;
+            const std::size_t dismissed = event_type::dismiss_wait_many(
+                this, futures.begin(), futures.end(),
+                [this](std::size_t i) { indexes.push_back(i); });
+            if ((pending += waited - dismissed) == 0)
+                complete();
+        }
+
+        void complete() {
+            this->set_value(T{ std::move(indexes), std::move(futures) });
+            shared_state<T>::signal();
+        }
+    };
+
+    std::unique_ptr<state> p { new state { std::move(futures) } };
+    using event_type = range_event_t<std::vector<Future> >;
+    std::size_t signaled;
+    std::tie(signaled, p->waited) =
+        event_type::wait_many(p.get(), p->futures.begin(), p->futures.end());
+    assert(signaled + p->waited >= k);
+    auto s = p.release();
+    s->wait(signaled < k ? k - signaled : 0);
+    return future<T>(s);
+}
+
 
 
 }
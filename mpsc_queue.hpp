@@ -37,6 +37,15 @@ struct mpsc_queue_base
         prev->m_next.store(n, std::memory_order_release);
     }
 
+    // Push the nodes linked from 'first' to 'last' with a single
+    // exchange.
+    void push_chain(node* first, node* last) {
+        last->m_next.store(0, std::memory_order_relaxed);
+        node* prev = m_head.exchange(last);
+        XASSERT(prev);
+        prev->m_next.store(first, std::memory_order_release);
+    }
+
     node * pop_unlocked() {
         auto tail = m_tail.m_next.load(std::memory_order_relaxed);
         if (tail == 0)
@@ -143,6 +152,10 @@ struct mpsc_queue : mpsc_queue_base {
         mpsc_queue_base::push(n);
     }
 
+    void push_chain(node* first, node* last) {
+        mpsc_queue_base::push_chain(first, last);
+    }
+
     void push_unlocked(node* n) {
         mpsc_queue_base::push_unlocked(n);
     }
@@ -0,0 +1,133 @@
+#ifndef GPD_MULTI_EVENT_HPP
+#define GPD_MULTI_EVENT_HPP
+#include "event.hpp"
+#include <atomic>
+#include <new>
+#include <thread>
+namespace gpd {
+
+/**
+ * One shot event with any number of subscribers, all signaled with
+ * it.
+ *
+ * Subscribers are events, waited as usual, linked in an intrusive
+ * stack: 'subscribe' pushes with a CAS and 'signal' takes the whole
+ * stack with an exchange, then signals every subscriber; both are
+ * lock-free. A subscriber leaving before the signal
+ * ('unsubscribe') takes the stack, drops itself and any other
+ * leaving subscriber, and puts the rest back, or signals them if the
+ * event has been signaled meanwhile. While another thread holds the
+ * stack, a leaving subscriber waits for it to drop or signal its
+ * node.
+ */
+struct multi_event {
+    struct subscriber : event {
+    private:
+        friend struct multi_event;
+        enum link_t { idle, linked, leaving };
+        subscriber * next = 0;
+        std::atomic<link_t> link = { idle };
+    };
+
+    multi_event() : head(nullptr) {}
+    multi_event(const multi_event&) = delete;
+    void operator=(const multi_event&) = delete;
+
+    /// Reset 's', which must not be subscribed, to the empty state and
+    /// subscribe it. If this is already signaled, signal 's' instead
+    /// and return false.
+    bool subscribe(subscriber * s) {
+        assert(s->link.load(std::memory_order_relaxed) == subscriber::idle);
+        s->~subscriber();
+        new (s) subscriber;
+        s->link.store(subscriber::linked, std::memory_order_relaxed);
+        auto h = head.load(std::memory_order_acquire);
+        do {
+            if (h == signaled()) {
+                s->link.store(subscriber::idle, std::memory_order_relaxed);
+                s->signal();
+                return false;
+            }
+            s->next = h;
+        } while (!head.compare_exchange_weak(h, s, std::memory_order_release,
+                                             std::memory_order_acquire));
+        return true;
+    }
+
+    /// Remove 's' if still subscribed and not signaled. When this
+    /// returns the event no longer touches 's', which may be
+    /// destroyed.
+    void unsubscribe(subscriber * s) {
+        if (s->link.exchange(subscriber::leaving, std::memory_order_acq_rel) ==
+            subscriber::idle) {
+            s->link.store(subscriber::idle, std::memory_order_relaxed);
+            return;
+        }
+        while (s->link.load(std::memory_order_acquire) != subscriber::idle &&
+               !s->is_signaled()) {
+            auto h = head.load(std::memory_order_acquire);
+            // signaled, or the subscribers are taken by another
+            // leaving one
+            if (h == signaled() || h == nullptr ||
+                !head.compare_exchange_weak(h, nullptr, std::memory_order_acquire)) {
+                std::this_thread::yield();
+                continue;
+            }
+            subscriber * keep = nullptr;
+            subscriber * tail = nullptr;
+            for (auto n = h; n; ) {
+                auto next = n->next;
+                if (n->link.load(std::memory_order_acquire) == subscriber::leaving)
+                    n->link.store(subscriber::idle, std::memory_order_release);
+                else {
+                    n->next = keep;
+                    keep = n;
+                    if (!tail) tail = n;
+                }
+                n = next;
+            }
+            if (keep)
+                put_back(keep, tail);
+        }
+        s->link.store(subscriber::idle, std::memory_order_relaxed);
+    }
+
+    /// Signal all subscribers. At most once.
+    void signal() {
+        auto h = head.exchange(signaled(), std::memory_order_acq_rel);
+        assert(h != signaled());
+        fire(h);
+    }
+
+    bool ready() const {
+        return head.load(std::memory_order_acquire) == signaled();
+    }
+
+private:
+    static subscriber * signaled() { return reinterpret_cast<subscriber*>(1); }
+
+    void put_back(subscriber * first, subscriber * last) {
+        auto h = head.load(std::memory_order_acquire);
+        do {
+            if (h == signaled())
+                return fire(first);
+            last->next = h;
+        } while (!head.compare_exchange_weak(h, first, std::memory_order_release,
+                                             std::memory_order_acquire));
+    }
+
+    // a subscriber may leave, or be destroyed, as soon as it is
+    // signaled; its waiter may well do so synchronously
+    static void fire(subscriber * n) {
+        while (n) {
+            auto next = n->next;
+            n->signal();
+            n = next;
+        }
+    }
+
+    std::atomic<subscriber*> head;
+};
+
+}
+#endif
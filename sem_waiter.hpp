@@ -2,9 +2,11 @@
 #define GPD_SEM_WAITER_HPP
 #include <semaphore.h>
 #include "event.hpp"
+#include "details/deadline.hpp"
+#include <time.h>
 namespace gpd {
 // Posix semaphore based waiter
-struct sem_waiter : waiter {
+struct sem_waiter : direct_waiter<sem_waiter> {
     sem_t sem;
     std::atomic<std::int32_t> signal_counter = { 0 };
 
@@ -14,23 +16,61 @@ struct sem_waiter : waiter {
         signal_counter.store(0, std::memory_order_relaxed);
     }
 
-    void signal(event_ptr p) override {
-        p.release();
+    void on_signal(event_base *) {
         auto v = --signal_counter;
         if (v == 0) {
             auto ret = ::sem_post(&sem);
             assert(ret == 0);
         }
     }
+
+    void signal_many(event_ptr * ps, std::size_t n) override {
+        for (std::size_t i = 0; i < n; ++i)
+            ps[i].release();
+        std::int32_t count = n;
+        auto old = signal_counter.fetch_sub(count);
+        if (old > 0 && old <= count) {
+            auto ret = ::sem_post(&sem);
+            assert(ret == 0);
+        }
+    }
     void wait(std::size_t count = 1) {
         auto v = signal_counter += count;
         if (v > 0)
-            while(auto ret = ::sem_wait(&sem))  {
-                if (ret == -1 && errno == EINTR) continue;
-                assert(ret == 0);
-            }
+            take();
+    }
+
+    /// As wait, but give up at 'deadline': the count is restored and
+    /// false returned.
+    bool wait_until(std::size_t count, deadline_clock::time_point deadline) {
+        std::int32_t n = count;
+        auto v = signal_counter += n;
+        if (v <= 0)
+            return true;
+        auto ts = details::to_timespec(deadline.time_since_epoch());
+        while(auto ret = ::sem_clockwait(&sem, CLOCK_MONOTONIC, &ts))  {
+            if (ret == -1 && errno == EINTR) continue;
+            assert(ret == -1 && errno == ETIMEDOUT);
+            // withdraw, unless the last signal got there first and
+            // is posting
+            v = signal_counter.load();
+            while (v > 0)
+                if (signal_counter.compare_exchange_weak(v, v - n))
+                    return false;
+            take();
+            break;
+        }
+        return true;
     }
     ~sem_waiter() { auto ret = ::sem_destroy(&sem); assert(ret == 0); }
+
+private:
+    void take() {
+        while(auto ret = ::sem_wait(&sem))  {
+            if (ret == -1 && errno == EINTR) continue;
+            assert(ret == 0);
+        }
+    }
 };
 
 
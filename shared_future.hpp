@@ -1,24 +1,20 @@
 #ifndef GPD_SHARED_FUTURE_HPP
 #define GPD_SHARED_FUTURE_HPP
 #include "future.hpp"
+#include "multi_event.hpp"
+#include <memory>
 
     
 namespace gpd {
+/// Shared state of all copies of a shared_future: receives the result
+/// of the original future and signals every copy.
 template<class T>
 struct shared_state_multiplexer : waiter, shared_state_union<T> {
+    multi_event event;
 
-    std::mutex mux;
-    std::deque<promise<bool> > listeners;
-    
     shared_state_multiplexer(future<T>&& future) {
         future.get_shared_state()->wait(this);
     }   
-    
-    auto lock() { return std::unique_lock<std::mutex> (mux);}
-    
-    future<bool> add_listener() {
-        return lock(),  listeners.emplace_back(), listeners.back().get_future();
-    }
 
     static auto as_shared_state(event_ptr p) {
         return std::unique_ptr<gpd::shared_state_union<T> >(
@@ -30,69 +26,72 @@ struct shared_state_multiplexer : waiter, shared_state_union<T> {
         assert(original);
         *static_cast<shared_state_union<T>*>(this) = std::move(*original);
         original.reset();
-        auto tmp_listeners = (lock(), std::exchange(listeners, {}));
-        for(auto&& p : tmp_listeners)
-            p.set_value(true);
+        event.signal();
     }
 };
 
+/// Each copy is a subscriber of the shared state's multi_event: no
+/// lock and no allocation per copy.
 template<class T>
 class shared_future {
     std::shared_ptr<shared_state_multiplexer<T> > state;
-    future<bool> listener;
+    multi_event::subscriber node;
     friend class future<T>;
 
+    void subscribe() { if (state) state->event.subscribe(&node); }
+    void unsubscribe() { if (state) state->event.unsubscribe(&node); }
+
 public:
-    friend event * get_event(shared_future& x) { return get_event(x.listener); }
+    using default_waiter = typename future<T>::default_waiter;
+
+    friend event * get_event(shared_future& x) {
+        return x.state ? &x.node : nullptr;
+    }
+
     shared_future(future<T>&& future)
         : state(new shared_state_multiplexer<T>(std::move(future)) )
-        , listener(state->add_listener())
     {
-        assert(listener.valid());
+        subscribe();
     }
       
-    shared_future() : state(0) {}
+    shared_future() {}
     shared_future(const shared_future& rhs)
         : state(rhs.state)
-        , listener(state ? state->add_listener() : future<bool>())
     {
-        assert(listener.valid());
+        subscribe();
     }
 
     shared_future(shared_future&& rhs)
-        : state(std::move(rhs.state)), listener(std::move(rhs.listener))
-    {}
+        : state(rhs.state)
+    {
+        rhs.unsubscribe();
+        rhs.state.reset();
+        subscribe();
+    }
     
     shared_future& operator=(shared_future rhs) {
-        state = std::move(rhs.state);
-        listener = std::move(rhs.listener);
+        unsubscribe();
+        state = rhs.state;
+        subscribe();
         return *this;
     }      
-    ~shared_future() {  }
+    ~shared_future() { unsubscribe(); }
 
-    template<class WaitStrategy>
-    T& get(WaitStrategy&& strategy) {
-        if (!ready())
-            wait(strategy);
+    template<class WaitStrategy=default_waiter>
+    T& get(WaitStrategy&& strategy = WaitStrategy{}) {
+        wait(strategy);
         return state->get();
     }
 
-    T& get() {
-        if (!ready())
-            wait();
-        return state->get();
-    }
+    bool valid() const { return bool(state); }
+    bool ready() const { return state && state->event.ready(); }
 
-    bool valid() const { return listener.valid(); }
-    bool ready() const { return listener.ready(); }
-
-    template<class WaitStrategy>
-    void wait(WaitStrategy&& strategy) {
-        listener.wait(strategy);
-    }
-
-    void wait() {
-        listener.wait();
+    template<class WaitStrategy=default_waiter>
+    void wait(WaitStrategy&& strategy = WaitStrategy{}) {
+        using gpd::wait;
+        assert(valid());
+        if (!ready())
+            wait(strategy, *this);
     }
 
     template<class F>
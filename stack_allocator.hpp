@@ -4,6 +4,12 @@
 #include <errno.h>
 #include <cassert>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "stack_registry.hpp"
+#include "stack_usage.hpp"
 
 namespace gpd {
 struct static_stack_allocator {
@@ -23,37 +29,312 @@ struct static_stack_allocator {
         free(ptr);
     }
 
+    static void deallocate(void * ptr, size_t) throw() {
+        deallocate(ptr);
+    }
+};
+
+/**
+ * Stack allocator based on anonymous mappings.
+ *
+ * The whole stack is reserved as address space only (MAP_NORESERVE);
+ * pages are committed by the kernel on first touch, so RSS is bounded
+ * by the actually used stack depth and even huge stack sizes are
+ * cheap. An additional PROT_NONE guard page is mapped right below the
+ * lowest stack address, so that a stack overflow faults instead of
+ * silently corrupting adjacent memory.
+ *
+ * If 'HugePages' is true, the stack is advised with MADV_HUGEPAGE.
+ *
+ * As munmap requires the mapping size, deallocate takes the size
+ * originally passed to allocate; use sized_stack_allocator to get the
+ * one argument deallocate expected by create_continuation.
+ */
+template<bool HugePages = false>
+struct mmap_stack_allocator {
+    enum { stack_size = static_stack_allocator::stack_size };
+    static const size_t alignment = 16;
+
+    static size_t page_size() {
+        static const size_t size = ::sysconf(_SC_PAGESIZE);
+        return size;
+    }
+
+    static size_t guard_size() { return page_size(); }
+
+    static void * allocate(size_t size = stack_size) {
+        assert(size % page_size() == 0);
+        void * base = ::mmap(0, size + guard_size(), PROT_READ|PROT_WRITE,
+                             MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED)
+            throw std::bad_alloc();
+        char * result = static_cast<char*>(base) + guard_size();
+        int ret = ::mprotect(base, guard_size(), PROT_NONE);
+        assert(ret == 0); (void)ret;
+#ifdef MADV_HUGEPAGE
+        if (HugePages)
+            ::madvise(result, size, MADV_HUGEPAGE);
+#endif
+        return result;
+    }
+
+    static void deallocate(void * ptr, size_t size) throw() {
+        int ret = ::munmap(static_cast<char*>(ptr) - guard_size(),
+                           size + guard_size());
+        assert(ret == 0); (void)ret;
+    }
+};
+
+/**
+ * Adapt an allocator whose deallocate requires the stack size to the
+ * interface expected by create_continuation, by remembering the size
+ * of the last allocated stack.
+ */
+template<class Base>
+struct sized_stack_allocator {
+    enum { stack_size = Base::stack_size };
+    static const size_t alignment = Base::alignment;
+
+    size_t size = 0;
+
+    void * allocate(size_t size = stack_size) {
+        void * result = Base::allocate(size);
+        this->size = size;
+        return result;
+    }
+
+    void deallocate(void * ptr) throw() {
+        assert(size);
+        Base::deallocate(ptr, size);
+    }
+};
+
+#ifdef GPD_MMAP_STACK_ALLOCATOR
+typedef mmap_stack_allocator<> base_stack_allocator;
+#else
+typedef static_stack_allocator base_stack_allocator;
+#endif
+
+namespace details {
+/// Size bucketed list of cached stacks. Lookups are linear as only a
+/// handful of distinct stack sizes are expected in a program.
+struct stack_cache {
+    struct bucket {
+        size_t size;
+        std::vector<void*> stacks;
+    };
+
+    std::vector<bucket> buckets;
+    size_t count = 0;
+
+    void * pop(size_t size) {
+        for (auto& b : buckets)
+            if (b.size == size && !b.stacks.empty()) {
+                void * result = b.stacks.back();
+                b.stacks.pop_back();
+                count--;
+                return result;
+            }
+        return 0;
+    }
+
+    void push(void * ptr, size_t size) {
+        for (auto& b : buckets)
+            if (b.size == size) {
+                b.stacks.push_back(ptr);
+                count++;
+                return;
+            }
+        buckets.push_back(bucket{size, {ptr}});
+        count++;
+    }
+
+    // Remove stacks until at most 'keep' are left, passing each one to
+    // 'release'. Returns the number of stacks removed.
+    template<class F>
+    size_t trim(size_t keep, F release) {
+        size_t removed = 0;
+        for (auto& b : buckets)
+            while (count > keep && !b.stacks.empty()) {
+                release(b.stacks.back(), b.size);
+                b.stacks.pop_back();
+                count--;
+                removed++;
+            }
+        return removed;
+    }
+};
+}
+
+/**
+ * Stack allocator that caches released stacks for reuse instead of
+ * returning them to the underlying 'Base' allocator.
+ *
+ * Released stacks are first put in a per-thread free list, keyed by
+ * stack size, holding up to 'LocalMax' stacks; any excess is moved to
+ * a global, mutex protected, overflow pool holding up to 'GlobalMax'
+ * stacks; what still does not fit is returned to 'Base'. Allocation
+ * looks in the same places in the same order.
+ *
+ * As deallocate is not passed the stack size, each allocator object
+ * remembers the size of the last stack it allocated; this works
+ * because create_continuation moves the allocator together with the
+ * stack it allocated.
+ *
+ * 'Base' must have a static allocate(size)/deallocate(ptr, size)
+ * interface.
+ */
+template<class Base = base_stack_allocator,
+         size_t LocalMax = 16,
+         size_t GlobalMax = 64>
+struct caching_stack_allocator {
+    enum { stack_size = Base::stack_size };
+    static const size_t alignment = Base::alignment;
+
+    size_t size = 0;
+
+    void * allocate(size_t size = stack_size) {
+        this->size = size;
+        if (void * result = local().pop(size))
+            return result;
+        {
+            std::lock_guard<std::mutex> _(global().mux);
+            if (void * result = global().cache.pop(size))
+                return result;
+        }
+        return Base::allocate(size);
+    }
+
+    void deallocate(void * ptr) throw() {
+        assert(size);
+        auto& cache = local();
+        cache.push(ptr, size);
+        if (cache.count > LocalMax)
+            cache.trim(LocalMax, &release_to_global);
+    }
+
+    /// Return to 'Base' all stacks cached by the calling thread and
+    /// all but 'keep' stacks from the global pool. Other threads' caches
+    /// are not touched. Returns the number of stacks released.
+    static size_t trim(size_t keep = 0) {
+        size_t removed = local().trim(0, &release_to_base);
+        std::lock_guard<std::mutex> _(global().mux);
+        return removed + global().cache.trim(keep, &release_to_base);
+    }
+
+    /// Number of stacks in the calling thread cache.
+    static size_t local_count() { return local().count; }
+
+    /// Number of stacks in the global overflow pool.
+    static size_t global_count() {
+        std::lock_guard<std::mutex> _(global().mux);
+        return global().cache.count;
+    }
+
+private:
+    struct local_cache : details::stack_cache {
+        ~local_cache() { trim(0, &release_to_global); }
+    };
+
+    struct global_cache {
+        std::mutex mux;
+        details::stack_cache cache;
+        ~global_cache() { cache.trim(0, &release_to_base); }
+    };
+
+    static local_cache& local() {
+        static thread_local local_cache cache;
+        return cache;
+    }
+
+    static global_cache& global() {
+        static global_cache cache;
+        return cache;
+    }
+
+    static void release_to_base(void * ptr, size_t size) {
+        Base::deallocate(ptr, size);
+    }
+
+    static void release_to_global(void * ptr, size_t size) {
+        {
+            std::lock_guard<std::mutex> _(global().mux);
+            if (global().cache.count < GlobalMax) {
+                global().cache.push(ptr, size);
+                return;
+            }
+        }
+        Base::deallocate(ptr, size);
+    }
 };
 
 struct debug_stack_allocator {
     static const size_t alignment = 16;
-    enum { stack_size = static_stack_allocator::stack_size };
+    enum { stack_size = base_stack_allocator::stack_size };
     void * allocate(size_t size) {
-        void * ret = static_stack_allocator::allocate(size);
+        void * ret = base_stack_allocator::allocate(size);
+        this->size = size;
         count++;
         return ret;
     }
 
     void deallocate(void * ptr) throw() {
         count--;
-        return static_stack_allocator::deallocate(ptr);
+        return base_stack_allocator::deallocate(ptr, size);
     }
 
     debug_stack_allocator(debug_stack_allocator&) = delete;
     
     int count;
-    debug_stack_allocator() : count(0) {}
-    debug_stack_allocator(debug_stack_allocator&& rhs) : count(rhs.count) {
+    size_t size;
+    debug_stack_allocator() : count(0), size(0) {}
+    debug_stack_allocator(debug_stack_allocator&& rhs)
+        : count(rhs.count), size(rhs.size) {
         rhs.count = 0;
     }
     ~debug_stack_allocator() { assert(count == 0); }
 };
 
 #ifdef NDEBUG
-typedef static_stack_allocator default_stack_allocator;
+typedef caching_stack_allocator<> unregistered_stack_allocator;
 #else
-typedef debug_stack_allocator default_stack_allocator;
+typedef debug_stack_allocator unregistered_stack_allocator;
 #endif
 
+// GPD_STACK_REGISTRY records all stacks allocated by default in the
+// stack_registry, enabling release_stack and the scheduler stack
+// release policy.
+#ifdef GPD_STACK_REGISTRY
+typedef registered_stack_allocator<unregistered_stack_allocator> 
+    uninstrumented_stack_allocator;
+#else
+typedef unregistered_stack_allocator uninstrumented_stack_allocator;
+#endif
+
+// GPD_STACK_USAGE measures the high water mark of all stacks
+// allocated by default, see stack_usage.hpp.
+#ifdef GPD_STACK_USAGE
+typedef instrumented_stack_allocator<uninstrumented_stack_allocator> 
+    default_stack_allocator;
+#else
+typedef uninstrumented_stack_allocator default_stack_allocator;
+#endif
+
+/**
+ * Size of the stack of a new continuation. Can be passed to callcc
+ * and async to override the default stack size.
+ *
+ * Custom sizes are simply stack_size_t{ bytes }; sizes should be a
+ * multiple of the page size.
+ */
+struct stack_size_t {
+    size_t size;
+};
+
+constexpr stack_size_t small_stack   = { 16*1024 };
+constexpr stack_size_t medium_stack  = { 64*1024 };
+constexpr stack_size_t large_stack   = { 1024*1024 };
+constexpr stack_size_t default_stack = { default_stack_allocator::stack_size };
+
 }
 #endif
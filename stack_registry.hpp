@@ -0,0 +1,223 @@
+#ifndef GPD_STACK_REGISTRY_HPP
+#define GPD_STACK_REGISTRY_HPP
+#include "details/switch_pair_accessor.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace gpd {
+
+template<class Signature>
+struct continuation;
+
+/// Resident memory of one or more stacks, before and after their
+/// unused pages have been released.
+struct stack_release_stats {
+    std::size_t resident_before = 0;
+    std::size_t resident_after = 0;
+
+    stack_release_stats& operator+=(const stack_release_stats& rhs) {
+        resident_before += rhs.resident_before;
+        resident_after  += rhs.resident_after;
+        return *this;
+    }
+};
+
+/**
+ * Process wide registry of the stacks allocated via
+ * registered_stack_allocator.
+ *
+ * Maps any address inside a stack, in particular the saved stack
+ * pointer of a halted continuation, back to the stack bounds, which
+ * is needed to give back to the OS the pages below the live part of
+ * the stack.
+ *
+ * Tasks parked by the scheduler are marked with park/unpark so that
+ * they can be trimmed by the idle path of the scheduler which parked
+ * them; a parked stack is never resumed before being unparked, and as
+ * both operations hold the registry lock, a stack is never trimmed
+ * while running.
+ */
+struct stack_registry {
+    typedef std::chrono::steady_clock clock;
+
+    struct entry {
+        std::size_t size;
+        void * parked_sp;
+        clock::time_point parked_at;
+        const void * owner;
+    };
+
+    static stack_registry& instance() {
+        static stack_registry registry;
+        return registry;
+    }
+
+    void add(void * base, std::size_t size) {
+        std::lock_guard<std::mutex> _(mux);
+        stacks[static_cast<char*>(base)] = entry{ size, 0, {}, 0 };
+    }
+
+    void remove(void * base) {
+        std::lock_guard<std::mutex> _(mux);
+        stacks.erase(static_cast<char*>(base));
+    }
+
+    /// Mark the stack containing 'sp' as parked at 'sp' by 'owner'
+    /// (e.g. a scheduler). Does nothing if 'sp' is not in a registered
+    /// stack.
+    void park(void * sp, const void * owner) {
+        std::lock_guard<std::mutex> _(mux);
+        auto i = find(sp);
+        if (i != stacks.end()) {
+            i->second.parked_sp = sp;
+            i->second.parked_at = clock::now();
+            i->second.owner = owner;
+        }
+    }
+
+    void unpark(void * sp) {
+        std::lock_guard<std::mutex> _(mux);
+        auto i = find(sp);
+        if (i != stacks.end())
+            i->second.parked_sp = 0;
+    }
+
+    /// Release the unused pages of the stack containing 'sp', which
+    /// must belong to an halted continuation.
+    stack_release_stats release(void * sp) {
+        std::lock_guard<std::mutex> _(mux);
+        auto i = find(sp);
+        if (i == stacks.end())
+            return {};
+        return release(i->first, i->second.size, sp);
+    }
+
+    /// Release the unused pages of the stacks parked by 'owner' before
+    /// 'before'.
+    stack_release_stats release_parked(clock::time_point before, const void * owner) {
+        stack_release_stats result;
+        std::lock_guard<std::mutex> _(mux);
+        for (auto& x : stacks)
+            if (x.second.parked_sp && x.second.owner == owner &&
+                x.second.parked_at < before) {
+                result += release(x.first, x.second.size, x.second.parked_sp);
+                x.second.parked_at = clock::time_point::max();
+            }
+        return result;
+    }
+
+    /// Number of resident bytes in the stack containing 'sp'.
+    std::size_t resident(void * sp) {
+        std::lock_guard<std::mutex> _(mux);
+        auto i = find(sp);
+        return i == stacks.end() ? 0 : resident(i->first, i->second.size);
+    }
+
+    static std::size_t page_size() {
+        static const std::size_t size = ::sysconf(_SC_PAGESIZE);
+        return size;
+    }
+
+private:
+    typedef std::map<char*, entry> map_t;
+
+    map_t::iterator find(void * vp) {
+        char * p = static_cast<char*>(vp);
+        auto i = stacks.upper_bound(p);
+        if (i == stacks.begin())
+            return stacks.end();
+        --i;
+        return p < i->first + i->second.size ? i : stacks.end();
+    }
+
+    static char * page_up(char * p) {
+        return (char*)(((std::uintptr_t)p + page_size() - 1) & ~(page_size() - 1));
+    }
+
+    static char * page_down(char * p) {
+        return (char*)((std::uintptr_t)p & ~(page_size() - 1));
+    }
+
+    static std::size_t resident(char * base, std::size_t size) {
+        char * begin = page_up(base);
+        char * end = page_down(base + size);
+        if (begin >= end)
+            return 0;
+        std::vector<unsigned char> pages((end - begin) / page_size());
+        if (::mincore(begin, end - begin, pages.data()) != 0)
+            return 0;
+        std::size_t count = 0;
+        for (auto x : pages)
+            count += x & 1;
+        return count * page_size();
+    }
+
+    // Release the pages from the bottom of the stack up to one page
+    // below the one containing 'sp', as slack for the red zone.
+    static stack_release_stats release(char * base, std::size_t size, void * sp) {
+        stack_release_stats result;
+        result.resident_before = resident(base, size);
+        char * begin = page_up(base);
+        char * end = page_down(static_cast<char*>(sp)) - page_size();
+        if (begin < end)
+            ::madvise(begin, end - begin, MADV_DONTNEED);
+        result.resident_after = resident(base, size);
+        return result;
+    }
+
+    std::mutex mux;
+    map_t stacks;
+};
+
+/**
+ * Stack allocator adaptor that records every stack allocated via
+ * 'Alloc' in the stack_registry.
+ */
+template<class Alloc>
+struct registered_stack_allocator {
+    enum { stack_size = Alloc::stack_size };
+    static const size_t alignment = Alloc::alignment;
+
+    Alloc alloc;
+
+    void * allocate(size_t size = stack_size) {
+        void * result = alloc.allocate(size);
+        stack_registry::instance().add(result, size);
+        return result;
+    }
+
+    void deallocate(void * ptr) throw() {
+        stack_registry::instance().remove(ptr);
+        alloc.deallocate(ptr);
+    }
+};
+
+/**
+ * Give back to the OS the pages of the stack of 'c' below its
+ * saved stack pointer; the stack must have been allocated with a
+ * registered_stack_allocator, otherwise this is a no-op.
+ *
+ * Precondition: !c.empty()
+ */
+template<class Signature>
+stack_release_stats release_stack(const continuation<Signature>& c) {
+    assert(!c.empty());
+    return stack_registry::instance().release(
+        details::switch_pair_accessor::get(c).sp.sp);
+}
+
+/// Number of resident bytes in the stack of 'c'.
+template<class Signature>
+std::size_t stack_resident(const continuation<Signature>& c) {
+    assert(!c.empty());
+    return stack_registry::instance().resident(
+        details::switch_pair_accessor::get(c).sp.sp);
+}
+}
+#endif
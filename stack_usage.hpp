@@ -0,0 +1,215 @@
+#ifndef GPD_STACK_USAGE_HPP
+#define GPD_STACK_USAGE_HPP
+#include "details/switch_pair_accessor.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * Stack high water mark instrumentation.
+ *
+ * instrumented_stack_allocator paints each new stack with a canary
+ * pattern; when the stack is deallocated, the deepest overwritten
+ * word gives the high water mark of the stack, which is added to the
+ * histogram of the allocator tag. Live stacks can be measured on
+ * demand with stack_high_water.
+ *
+ * Only the top GPD_STACK_USAGE_PAINT_SIZE bytes of each stack are
+ * painted (and thus committed), so that huge virtual stacks can be
+ * instrumented; deeper usages are reported as saturated.
+ *
+ * Define GPD_STACK_USAGE to instrument all stacks allocated by the
+ * default allocator, with the "default" tag.
+ *
+ * NOTE: pages released with release_stack read back as zeros and
+ * count as used.
+ */
+#ifndef GPD_STACK_USAGE_PAINT_SIZE
+#define GPD_STACK_USAGE_PAINT_SIZE (1024*1024)
+#endif
+
+namespace gpd {
+
+template<class Signature>
+struct continuation;
+
+/// Histogram of the high water marks of the stacks of a tag.
+struct stack_usage_histogram {
+    enum { bucket_count = 32 };
+
+    /// buckets[i] counts the stacks whose high water mark, in bytes,
+    /// is in [2^i, 2^(i+1)); bucket 0 also counts unused stacks.
+    std::size_t buckets[bucket_count] = {};
+    std::size_t samples = 0;
+    std::size_t max_used = 0;
+    /// Samples which used all the painted area: their high water mark
+    /// is only a lower bound.
+    std::size_t saturated = 0;
+
+    void add(std::size_t used, bool full) {
+        std::size_t i = 0;
+        while (i + 1 < bucket_count && (used >> (i + 1)))
+            ++i;
+        buckets[i]++;
+        samples++;
+        saturated += full;
+        max_used = std::max(max_used, used);
+    }
+
+    /// An upper bound of the high water mark of a fraction 'p' of
+    /// the samples, e.g. percentile(0.99). Zero if there are no
+    /// samples.
+    std::size_t percentile(double p) const {
+        std::size_t seen = 0;
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            seen += buckets[i];
+            if (samples && seen >= p * samples)
+                return std::min(max_used, (std::size_t(2) << i) - 1);
+        }
+        return max_used;
+    }
+};
+
+/// Process wide registry of the stacks allocated via
+/// instrumented_stack_allocator and of the histograms by tag.
+struct stack_usage_registry {
+    static stack_usage_registry& instance() {
+        static stack_usage_registry registry;
+        return registry;
+    }
+
+    void add(void * base, std::size_t size, const char * tag) {
+        paint(static_cast<char*>(base), size);
+        std::lock_guard<std::mutex> _(mux);
+        stacks[static_cast<char*>(base)] = entry{ size, tag };
+    }
+
+    /// Unregister the stack at 'base' and record its usage.
+    void remove(void * base) {
+        std::lock_guard<std::mutex> _(mux);
+        auto i = stacks.find(static_cast<char*>(base));
+        assert(i != stacks.end());
+        bool full;
+        std::size_t used = high_water(i->first, i->second.size, full);
+        histograms[i->second.tag].add(used, full);
+        stacks.erase(i);
+    }
+
+    /// High water mark of the live stack containing 'sp', zero if
+    /// 'sp' is not in an instrumented stack.
+    std::size_t high_water(void * sp) {
+        std::lock_guard<std::mutex> _(mux);
+        char * p = static_cast<char*>(sp);
+        auto i = stacks.upper_bound(p);
+        if (i == stacks.begin())
+            return 0;
+        --i;
+        if (p >= i->first + i->second.size)
+            return 0;
+        bool full;
+        return high_water(i->first, i->second.size, full);
+    }
+
+    std::map<std::string, stack_usage_histogram> report() {
+        std::lock_guard<std::mutex> _(mux);
+        return histograms;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> _(mux);
+        histograms.clear();
+    }
+
+private:
+    struct entry {
+        std::size_t size;
+        const char * tag;
+    };
+
+    static std::size_t painted(std::size_t size) {
+        return std::min<std::size_t>(size, GPD_STACK_USAGE_PAINT_SIZE) & ~std::size_t(7);
+    }
+
+    static const std::uint64_t canary = 0xfeedfacecafebeefull;
+
+    static void paint(char * base, std::size_t size) {
+        const std::uint64_t canary = stack_usage_registry::canary;
+        std::size_t n = painted(size);
+        char * begin = base + size - n;
+        for (std::size_t i = 0; i < n; i += sizeof canary)
+            std::memcpy(begin + i, &canary, sizeof canary);
+    }
+
+    static std::size_t high_water(char * base, std::size_t size, bool& full) {
+        const std::uint64_t canary = stack_usage_registry::canary;
+        std::size_t n = painted(size);
+        char * begin = base + size - n;
+        std::size_t i = 0;
+        for (; i < n; i += sizeof canary)
+            if (std::memcmp(begin + i, &canary, sizeof canary) != 0)
+                break;
+        full = (i == 0 && n != 0);
+        return n - i;
+    }
+
+    std::mutex mux;
+    std::map<char*, entry> stacks;
+    std::map<std::string, stack_usage_histogram> histograms;
+};
+
+/**
+ * Stack allocator adaptor measuring the high water mark of every
+ * stack allocated via 'Alloc'; the measurements are aggregated under
+ * 'tag', which must be a string with static storage duration.
+ */
+template<class Alloc>
+struct instrumented_stack_allocator {
+    enum { stack_size = Alloc::stack_size };
+    static const size_t alignment = Alloc::alignment;
+
+    Alloc alloc;
+    const char * tag;
+
+    explicit instrumented_stack_allocator(const char * tag = "default")
+        : tag(tag) {}
+
+    void * allocate(size_t size = stack_size) {
+        void * result = alloc.allocate(size);
+        stack_usage_registry::instance().add(result, size, tag);
+        return result;
+    }
+
+    void deallocate(void * ptr) throw() {
+        stack_usage_registry::instance().remove(ptr);
+        alloc.deallocate(ptr);
+    }
+};
+
+/// Histograms of the stack high water marks of all the deallocated
+/// instrumented stacks, by tag.
+inline std::map<std::string, stack_usage_histogram> stack_usage_report() {
+    return stack_usage_registry::instance().report();
+}
+
+inline void stack_usage_reset() {
+    stack_usage_registry::instance().reset();
+}
+
+/**
+ * High water mark of the stack of 'c', which must have been allocated
+ * with an instrumented_stack_allocator, otherwise zero.
+ *
+ * Precondition: !c.empty()
+ */
+template<class Signature>
+std::size_t stack_high_water(const continuation<Signature>& c) {
+    assert(!c.empty());
+    return stack_usage_registry::instance().high_water(
+        details::switch_pair_accessor::get(c).sp.sp);
+}
+}
+#endif
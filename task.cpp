@@ -3,6 +3,7 @@
 #include "fd_waiter.hpp"
 #include <mutex>
 #include <set>
+#include <vector>
 namespace gpd {
 namespace {
 
@@ -50,8 +51,53 @@ struct scheduler {
                 waiter.signal({});
         }
     }
+
+    /// Push from another thread the nodes linked from 'first' to
+    /// 'last', with a single wake up.
+    void push_chain(node* first, node* last) {
+        int pri = generation.load(std::memory_order_relaxed) + 1;
+        for (auto n = first; ; n = static_cast<node*>(n->m_next.load(std::memory_order_relaxed))) {
+            n->pri = pri;
+            if (n == last) break;
+        }
+        remote_tasks.push_chain(first, last); // seq_cst
+        if (waiting)
+            waiter.signal({});
+    }
+
+    /// Like pop, but if there are no ready tasks, release the stacks
+    /// parked for long enough and sleep until there are.
+    node* pop_wait() {
+        auto next = pop();
+        if (next == 0) {
+            auto release_after = stack_registry::clock::duration(
+                this->release_after.load(std::memory_order_relaxed));
+            if (release_after != stack_registry::clock::duration::max()) {
+                auto stats = stack_registry::instance().release_parked(
+                    stack_registry::clock::now() - release_after, this);
+                released_before += stats.resident_before;
+                released_after += stats.resident_after;
+            }
+
+            waiting.exchange(true);
+            waiter.reset();
+            while ((next = pop()) == 0)
+                waiter.wait();
+            waiting.store(0, std::memory_order_relaxed);
+        }
+        return next;
+    }
     
     bool pinned = false;
+    std::atomic<std::size_t> stack_size = { default_stack.size };
+    std::atomic<stack_registry::clock::rep> release_after =
+        { stack_registry::clock::duration::max().count() };
+    std::atomic<std::size_t> released_before = { 0 };
+    std::atomic<std::size_t> released_after = { 0 };
+    // Parked sleeper and the node it must run first, if any, see
+    // scheduler_sleeper; only accessed by the scheduler thread.
+    task_t sleeper;
+    node * handoff = 0;
 private:
 
     static std::uint64_t get_pri(mpsc_queue<node>& q) {
@@ -69,6 +115,42 @@ private:
 };
 
 
+namespace {
+
+// Posts to other schedulers deferred to the end of the current
+// signal_batch, chained by target.
+struct batched_posts : signal_batch::flusher {
+    struct chain { scheduler * target; scheduler::node * first; scheduler::node * last; };
+    std::vector<chain> chains;
+    bool deferred = false;
+
+    void add(scheduler& target, scheduler::node& n) {
+        if (!deferred) {
+            signal_batch::current()->defer(this);
+            deferred = true;
+        }
+        n.m_next.store(0, std::memory_order_relaxed);
+        for (auto& c : chains)
+            if (c.target == &target) {
+                c.last->m_next.store(&n, std::memory_order_relaxed);
+                c.last = &n;
+                return;
+            }
+        chains.push_back({ &target, &n, &n });
+    }
+
+    void flush() override {
+        deferred = false;
+        auto ready = std::exchange(chains, {});
+        for (auto& c : ready)
+            c.target->push_chain(c.first, c.last);
+    }
+};
+
+thread_local batched_posts batched;
+
+}
+
 namespace details {
 
 scheduler_node::scheduler_node()
@@ -90,34 +172,102 @@ scheduler& scheduler_get_local() {
     return *scheduler_ptr;
 }
 
+stack_size_t scheduler_stack_size(scheduler& sched) {
+    return { sched.stack_size.load(std::memory_order_relaxed) };
+}
+
+void scheduler_park(details::scheduler_node& n) {
+    if (scheduler_ptr && scheduler_ptr->release_after.load(std::memory_order_relaxed) !=
+        stack_registry::clock::duration::max().count()) {
+        stack_registry::instance().park(switch_pair_accessor::get(n.task).sp.sp,
+                                        scheduler_ptr);
+        n.parked = true;
+    }
+}
+
 void scheduler_post(details::scheduler_node& n) {
+    if (n.parked) {
+        stack_registry::instance().unpark(switch_pair_accessor::get(n.task).sp.sp);
+        n.parked = false;
+    }
     assert(n.sched || scheduler_ptr);
     assert(!n.pinned || n.sched);
-    if ( (n.pinned && n.stolen()) || !scheduler_ptr)
-        n.sched->push(&n);
+    auto& target = (n.pinned && n.stolen()) || !scheduler_ptr ?
+        *n.sched : *scheduler_ptr;
+    if (&target != scheduler_ptr && signal_batch::current())
+        batched.add(target, n);
     else
-        scheduler_ptr->push(&n);
+        target.push(&n);
+}
+
+void scheduler_push(scheduler& sched, scheduler_node& n) {
+    sched.push(&n);
+}
+
+// Body of the sleepers: the contexts, on stacks of the scheduler size,
+// which run the stackless tasks in place and sleep when there is
+// nothing to run. A sleeper switching to a stackful task parks itself
+// in its scheduler for reuse, unless another one took its place while
+// it was tied up by a suspended stackless task; then it finishes.
+static task_t scheduler_sleep() {
+    while (true) {
+        auto& sched = scheduler_get_local();
+        auto * next = std::exchange(sched.handoff, nullptr);
+        if (!next)
+            next = sched.pop_wait();
+        if (next->run) {
+            next->run(*next);
+            continue;
+        }
+        if (sched.sleeper)
+            return std::move(next->task);
+        auto old = callcc(
+            std::move(next->task),
+            [&sched](task_t self) {
+                sched.sleeper = std::move(self);
+                return self;
+            });
+        assert(!old);
+    }
+}
+
+// Return the sleeper of 'sched', which runs 'first' before anything
+// else if given.
+static task_t scheduler_sleeper(scheduler& sched, scheduler_node * first) {
+    sched.handoff = first;
+    if (sched.sleeper)
+        return std::move(sched.sleeper);
+    return create_deferred_continuation<void()>(
+        [](task_t) { return scheduler_sleep(); },
+        default_stack_allocator(),
+        sched.stack_size.load(std::memory_order_relaxed));
 }
 
+// Stackless tasks are never run on the stack of the calling task,
+// whose size is unknown, but handed to the sleeper.
 task_t scheduler_pop() {
-    auto * next = scheduler_get_local().pop();
-    assert(next);
+    auto& sched = scheduler_get_local();
+    auto * next = sched.pop();
+    if (!next || next->run)
+        return scheduler_sleeper(sched, next);
     return std::move(next->task);
 }
 
+task_t scheduler_next() {
+    return scheduler_pop();
+}
+
 }
 
 
 void idle(scheduler& sched) {
     scheduler_saver _ (sched);
 
-    auto next = sched.pop();
-    if (next == 0) {
-        sched.waiting.exchange(true);
-        sched.waiter.reset();
-        while ((next = sched.pop()) == 0)
-            sched.waiter.wait();
-        sched.waiting.store(0, std::memory_order_relaxed);
+    auto next = sched.pop_wait();
+    if (next->run) {
+        // stackless task: run it on the idle stack
+        next->run(*next);
+        return;
     }
 
     scheduler::node self;
@@ -131,6 +281,22 @@ void idle(scheduler& sched) {
     assert(!old);
 }
 
+void set_stack_size(scheduler& target, stack_size_t size) {
+    target.stack_size.store(size.size, std::memory_order_relaxed);
+}
+
+void set_stack_release_policy(scheduler& target,
+                              std::chrono::steady_clock::duration min_parked) {
+    target.release_after.store(min_parked.count(), std::memory_order_relaxed);
+}
+
+stack_release_stats stack_release_totals(scheduler& target) {
+    stack_release_stats result;
+    result.resident_before = target.released_before.load();
+    result.resident_after = target.released_after.load();
+    return result;
+}
+
 future<scheduler*> start_background_scheduler() {
     promise<scheduler*> result;
     auto future = result.get_future();
@@ -170,17 +336,26 @@ void yield() {
     yield(details::scheduler_get_local(), details::scheduler_pop());
 }
 
-void details::scheduler_waiter::signal(event_ptr p) {
-    p.release();
+void details::scheduler_waiter::on_signal(event_base *) {
     if (--signal_counter == 0) 
         details::scheduler_post(*this);    
 }
 
+void details::scheduler_waiter::signal_many(event_ptr * ps, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i)
+        ps[i].release();
+    std::int32_t count = n;
+    auto old = signal_counter.fetch_sub(count);
+    if (old > 0 && old <= count)
+        details::scheduler_post(*this);
+}
+
 void details::scheduler_waiter::wait(std::uint32_t count) {
     auto to = callcc
         (details::scheduler_pop(),
          [&](task_t c) {
             task = std::move(c);
+            details::scheduler_park(*this);
             if ((signal_counter += count) <= 0)
                 details::scheduler_post(*this);
             return c;
@@ -2,6 +2,7 @@
 #define GPD_TASK_HPP
 #include "continuation.hpp"
 #include "future.hpp"
+#include "fiber_pool.hpp"
 #include "node.hpp"
 namespace gpd {
 
@@ -12,6 +13,9 @@ struct scheduler;
 
 constexpr struct scheduler_tag {} pool;
 
+/// Tag to spawn a task without a stack, see async.
+constexpr struct stackless_tag {} stackless = {};
+
 namespace details {
 
 struct scheduler_node : gpd::node {
@@ -22,17 +26,26 @@ struct scheduler_node : gpd::node {
     std::uint64_t pri;
     scheduler* sched;
     bool pinned;
+    bool parked = false;
     task_t task;
+    /// If set, a stackless task: run(*this) is called in place of
+    /// resuming 'task' and destroys the node.
+    void (*run)(scheduler_node&) = 0;
 };
 
 scheduler& scheduler_get_local();
+stack_size_t scheduler_stack_size(scheduler& sched);
 void scheduler_post(scheduler_node& n);
+void scheduler_push(scheduler& sched, scheduler_node& n);
+void scheduler_park(scheduler_node& n);
 task_t scheduler_pop();
+task_t scheduler_next();
 
-struct scheduler_waiter : waiter, details::scheduler_node {
+struct scheduler_waiter : direct_waiter<scheduler_waiter>, details::scheduler_node {
     std::atomic<std::int32_t> signal_counter = { 0 };
     void reset() { signal_counter.store(0, std::memory_order_relaxed); }
-    void signal(event_ptr p) override;
+    void on_signal(event_base *);
+    void signal_many(event_ptr * ps, std::size_t n) override;
     void wait(std::uint32_t count = 1);
 };
 }
@@ -59,16 +72,75 @@ void yield(task_t next);
 /// front of the current scheduler ready queue queue.
 void yield();
 
+/// Set the default stack size of tasks spawned via async on 'target'.
+void set_stack_size(scheduler& target, stack_size_t size);
+
+/// When 'target' runs out of ready tasks, release the unused stack
+/// pages of the tasks it parked that have been waiting for longer
+/// than 'min_parked'. Only stacks from a registered_stack_allocator
+/// (all of them with GPD_STACK_REGISTRY) are released; pass
+/// duration::max() to disable (the default).
+void set_stack_release_policy(scheduler& target,
+                              std::chrono::steady_clock::duration min_parked);
+
+/// Resident stack memory before and after each release, summed over
+/// all the releases done by 'target'.
+stack_release_stats stack_release_totals(scheduler& target);
+
+/// Run 'f' in a new task on the 'target' scheduler (or on the current
+/// scheduler for 'pool'). Return a future to the result of 'f'.
+///
+/// The stack size of the task is 'size' if specified, otherwise the
+/// default stack size of 'target'.
 template<class F>
 auto async(scheduler& target, F&&f);
 
+template<class F>
+auto async(scheduler& target, stack_size_t size, F&&f);
+
 template<class F>
 auto async(scheduler_tag, F&&f);
 
+template<class F>
+auto async(scheduler_tag, stack_size_t size, F&&f);
+
+/// Run 'f' in a new task on 'target' (or on the current scheduler
+/// for 'pool'), on a fiber drawn from 'fibers'; the fiber goes back
+/// to 'fibers' when the task is done.
+template<class StackAlloc, class F>
+auto async(scheduler& target, fiber_pool<StackAlloc>& fibers, F&&f);
+
+template<class StackAlloc, class F>
+auto async(scheduler_tag, fiber_pool<StackAlloc>& fibers, F&&f);
+
+/// Run 'f' as a stackless task on 'target' (or on the current
+/// scheduler for 'pool'): 'f' is queued as a plain callable and run
+/// in place on the idle stack of the scheduler, or on a stack of the
+/// scheduler size kept for the purpose, saving the stack allocation
+/// and most of the context switches of a task.
+///
+/// Meant for work that rarely or never suspends. 'f' can still wait
+/// or yield, but the stack it borrowed stays tied up until it
+/// completes, so it must not wait for work which needs that stack
+/// to make progress.
+template<class F>
+auto async(scheduler& target, stackless_tag, F&&f);
+
+template<class F>
+auto async(scheduler_tag, stackless_tag, F&&f);
+
 
 /// wait{,_any,_all} customization point for the scheduler
 template<class... Waitable>
-void wait_any_adl(scheduler_tag, Waitable&... w);
+std::size_t wait_any_adl(scheduler_tag, Waitable&... w);
+
+template<class WaitableRange>
+std::size_t wait_any_ready_adl(scheduler_tag, std::vector<bool>& ready,
+                               WaitableRange&& events);
+
+template<class WaitableRange>
+std::size_t wait_some_adl(scheduler_tag, std::size_t k, std::vector<bool>& ready,
+                          WaitableRange&& events);
 
 template<class... Waitable>
 void wait_all_adl(scheduler_tag, Waitable&... w);
@@ -79,34 +151,110 @@ void wait_adl(scheduler_tag, Waitable& w);
 
 template<class F>
 auto async(scheduler& target, F&&f)  {
+    return async(target, details::scheduler_stack_size(target),
+                 std::forward<F>(f));
+}
 
-    struct {
-        scheduler& target;
-        std::decay_t<F> f;
-        gpd::promise<decltype(f())> promise;
-
-        auto operator()(task_t caller) {
-            yield(target, std::move(caller));
-            eval_into(promise, f);
-            return details::scheduler_pop();
-        }
-    } run { target, std::forward<F>(f), {} };
-    
+namespace details {
+template<class F>
+struct async_task {
+    scheduler& target;
+    F f;
+    gpd::promise<decltype(f())> promise;
+
+    task_t operator()(task_t caller) {
+        yield(target, std::move(caller));
+        eval_into(promise, f);
+        return details::scheduler_next();
+    }
+};
+}
+
+template<class F>
+auto async(scheduler& target, stack_size_t size, F&&f)  {
+    details::async_task<std::decay_t<F>> run { target, std::forward<F>(f), {} };
     auto future = run.promise.get_future();
-    auto c = callcc(std::move(run));
+    auto c = callcc(size, std::move(run));
+    return future;
+}
+
+template<class StackAlloc, class F>
+auto async(scheduler& target, fiber_pool<StackAlloc>& fibers, F&&f)  {
+    details::async_task<std::decay_t<F>> run { target, std::forward<F>(f), {} };
+    auto future = run.promise.get_future();
+    auto c = fibers.callcc(std::move(run));
+    return future;
+}
+
+template<class StackAlloc, class F>
+auto async(scheduler_tag, fiber_pool<StackAlloc>& fibers, F&&f) {
+    return async(details::scheduler_get_local(), fibers, std::forward<F>(f));
+}
+
+namespace details {
+template<class F>
+struct stackless_task : scheduler_node {
+    F f;
+    gpd::promise<decltype(f())> promise;
+
+    stackless_task(F f) : f(std::move(f)) {
+        // not owned by the spawning scheduler
+        sched = 0;
+        pinned = false;
+        run = &stackless_task::invoke;
+    }
+
+    static void invoke(scheduler_node& n) {
+        auto self = static_cast<stackless_task*>(&n);
+        fiber_storage_scope fls(true);
+        eval_into(self->promise, self->f);
+        delete self;
+    }
+};
+}
+
+template<class F>
+auto async(scheduler& target, stackless_tag, F&&f)  {
+    auto n = new details::stackless_task<std::decay_t<F>>(std::forward<F>(f));
+    auto future = n->promise.get_future();
+    details::scheduler_push(target, *n);
     return future;
 }
 
+template<class F>
+auto async(scheduler_tag, stackless_tag, F&&f) {
+    return async(details::scheduler_get_local(), stackless, std::forward<F>(f));
+}
+
 template<class F>
 auto async(scheduler_tag, F&&f) {
     return async(details::scheduler_get_local(), std::forward<F>(f));
 }
 
+template<class F>
+auto async(scheduler_tag, stack_size_t size, F&&f) {
+    return async(details::scheduler_get_local(), size, std::forward<F>(f));
+}
+
 
 template<class... Waitable>
-void wait_any_adl(scheduler_tag, Waitable&... w) {
+std::size_t wait_any_adl(scheduler_tag, Waitable&... w) {
+    details::scheduler_waiter waiter;
+    return gpd::wait_any(waiter, w...);
+}
+
+template<class WaitableRange>
+std::size_t wait_any_ready_adl(scheduler_tag, std::vector<bool>& ready,
+                               WaitableRange&& events) {
+    details::scheduler_waiter waiter;
+    return gpd::wait_any_ready(waiter, ready, events);
+}
+
+template<class WaitableRange>
+std::size_t wait_some_adl(scheduler_tag, std::size_t k, std::vector<bool>& ready,
+                          WaitableRange&& events) {
     details::scheduler_waiter waiter;
-    gpd::wait_any(waiter, w...);
+    return gpd::wait_some(waiter, k, ready, events);
 }
 
 template<class... Waitable>
@@ -118,9 +266,8 @@ void wait_all_adl(scheduler_tag, Waitable&... w) {
 template<class Waitable>
 void wait_adl(scheduler_tag, Waitable& w) {
     if (auto * event = get_event(w)) {    
-        struct task_latch : waiter, details::scheduler_node {
-            void signal(event_ptr p) override {
-                p.release();
+        struct task_latch : direct_waiter<task_latch>, details::scheduler_node {
+            void on_signal(event_base *) {
                 details::scheduler_post(*this);
             }
         } waiter;
@@ -129,6 +276,7 @@ void wait_adl(scheduler_tag, Waitable& w) {
             (details::scheduler_pop(),
              [&](task_t c) {
                 waiter.task = std::move(c);
+                details::scheduler_park(waiter);
                 event->wait(&waiter);
                 return c;
             });
@@ -0,0 +1,90 @@
+#ifndef GPD_TASK_ACCOUNTING_HPP
+#define GPD_TASK_ACCOUNTING_HPP
+#include "details/fiber_storage.hpp"
+#include "details/task_account.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+/**
+ * Per task CPU time and switch accounting.
+ *
+ * Define GPD_TASK_ACCOUNTING, in all translation units, libraries
+ * included (link libtask_task_accounting instead of libtask), to have
+ * every execution context (continuation, pooled fiber job or stackless
+ * task) count the TSC cycles it runs for, how many times it is
+ * resumed and how many times it is resumed on a different thread than
+ * the previous time, i.e. migrated between schedulers. The counters
+ * are updated in the stack_switch and execute_into wrappers, around
+ * the switch proper.
+ *
+ * When GPD_TASK_ACCOUNTING is not defined nothing is counted, the
+ * switch path is unchanged and the functions below report nothing.
+ */
+namespace gpd {
+
+/// Counters of the running context. The cycles of the current run are
+/// included.
+inline task_stats current_task_stats() {
+#ifdef GPD_TASK_ACCOUNTING
+    auto& account = details::fiber_storage::current().account;
+    auto now = details::account_clock();
+    account.leave(now);
+    account.enter(now, false);
+    return account.stats();
+#else
+    return task_stats();
+#endif
+}
+
+/// Label the running context in reports; the totals of finished
+/// contexts are aggregated by label. 'label' must have static storage
+/// duration.
+inline void set_task_label(const char * label) {
+#ifdef GPD_TASK_ACCOUNTING
+    details::task_account_registry::instance().set_label(
+        details::fiber_storage::current().account, label);
+#else
+    (void)label;
+#endif
+}
+
+/// The 'n' top consumers of cycles, among the live contexts and the
+/// totals of the finished contexts by label, in decreasing order.
+inline std::vector<task_usage> top_tasks(std::size_t n = 10) {
+#ifdef GPD_TASK_ACCOUNTING
+    auto result = details::task_account_registry::instance().snapshot();
+    auto by_cycles = [](const task_usage& a, const task_usage& b) {
+        return a.stats.cycles > b.stats.cycles;
+    };
+    if (result.size() > n) {
+        std::partial_sort(result.begin(), result.begin() + n, result.end(), by_cycles);
+        result.resize(n);
+    } else
+        std::sort(result.begin(), result.end(), by_cycles);
+    return result;
+#else
+    (void)n;
+    return {};
+#endif
+}
+
+/// Print top_tasks(n), one per line.
+inline void dump_top_tasks(std::ostream& out, std::size_t n = 10) {
+    for (auto& t : top_tasks(n))
+        out << t.label << (t.live ? " (live)" : "")
+            << ": cycles " << t.stats.cycles
+            << ", resumes " << t.stats.resumes
+            << ", migrations " << t.stats.migrations << '\n';
+}
+
+/// Forget the totals of the finished contexts.
+inline void reset_task_totals() {
+#ifdef GPD_TASK_ACCOUNTING
+    details::task_account_registry::instance().reset();
+#endif
+}
+
+}
+#endif
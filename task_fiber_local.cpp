@@ -0,0 +1,4 @@
+// libtask for programs built with GPD_FIBER_LOCAL, whose switch path
+// differs; see details/fiber_storage.hpp.
+#define GPD_FIBER_LOCAL
+#include "task.cpp"
@@ -0,0 +1,4 @@
+// libtask for programs built with GPD_SHARED_STACK, whose switch path
+// differs; see details/shared_stack.hpp.
+#define GPD_SHARED_STACK
+#include "task.cpp"
@@ -0,0 +1,4 @@
+// libtask for programs built with GPD_TASK_ACCOUNTING, whose switch
+// path and fiber storage differ; see task_accounting.hpp.
+#define GPD_TASK_ACCOUNTING
+#include "task.cpp"
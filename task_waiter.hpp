@@ -6,7 +6,7 @@
 namespace gpd {
 using task_t = continuation<void()>;
 
-struct task_waiter : waiter {
+struct task_waiter : direct_waiter<task_waiter> {
     task_t next;
     task_t get() { return std::move(next); }
 
@@ -18,10 +18,11 @@ struct task_waiter : waiter {
         signal_counter.store(0, std::memory_order_relaxed);
     }
     
-    void signal(event_ptr p) override {
-        p.release();
-        if (--signal_counter == 0) 
+    void on_signal(event_base *) {
+        if (--signal_counter == 0) {
+            signal_batch::pause unbatched;
             get()();
+        }
     }
 
     void wait(std::uint32_t count = 1) {
@@ -39,10 +40,29 @@ struct task_waiter : waiter {
 
 
 template<class... Waitable>
-void wait_any_adl(task_t& to, Waitable&... w) {
+std::size_t wait_any_adl(task_t& to, Waitable&... w) {
+    task_waiter waiter(std::move(to));
+    auto index = gpd::wait_any(waiter, w...);
+    to = waiter.get();
+    return index;
+}
+
+template<class WaitableRange>
+std::size_t wait_any_ready_adl(task_t& to, std::vector<bool>& ready,
+                               WaitableRange&& events) {
+    task_waiter waiter(std::move(to));
+    auto count = gpd::wait_any_ready(waiter, ready, events);
+    to = waiter.get();
+    return count;
+}
+
+template<class WaitableRange>
+std::size_t wait_some_adl(task_t& to, std::size_t k, std::vector<bool>& ready,
+                          WaitableRange&& events) {
     task_waiter waiter(std::move(to));
-    gpd::wait_any(waiter, w...);
+    auto count = gpd::wait_some(waiter, k, ready, events);
     to = waiter.get();
+    return count;
 }
 
 template<class... Waitable>
@@ -56,11 +76,11 @@ void wait_all_adl(task_t& to, Waitable&... w) {
 template<class Waitable>
 void wait_adl(task_t& to, Waitable& w) {
     if (get_event(w) == 0) return;
-    struct task_latch : waiter {
+    struct task_latch : direct_waiter<task_latch> {
         task_t next;
-        void signal(event_ptr p) override {
-            p.release();
+        void on_signal(event_base *) {
             auto next = std::move(this->next);
+            signal_batch::pause unbatched;
             next();
         }
         ~task_latch() { }
@@ -0,0 +1,135 @@
+#include "continuation.hpp"
+#include "fiber_pool.hpp"
+#include <cassert>
+#include <csignal>
+#include <cstring>
+#include <execinfo.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+using namespace gpd;
+
+enum { max_frames = 128 };
+
+volatile int sink;
+
+__attribute__((noinline)) int deep_backtrace(int depth, void ** frames) {
+    if (depth > 0) {
+        int n = deep_backtrace(depth - 1, frames);
+        sink = depth; // not a tail call
+        return n;
+    }
+    return backtrace(frames, max_frames);
+}
+
+/// The backtrace of a context ends at its entry.
+void check_backtrace(int n, void ** frames, int depth) {
+    assert(n > depth && n < max_frames);
+    assert(frames[n - 1] == (void*)&context_root_impl);
+}
+
+// frames are recorded from the profiling signal handler while the
+// continuations ping-pong
+volatile sig_atomic_t samples = 0;
+volatile sig_atomic_t in_switch = 0;
+volatile sig_atomic_t in_switch_truncated = 0;
+
+void on_sample(int, siginfo_t *, void * uc) {
+    void * frames[max_frames];
+    int n = backtrace(frames, max_frames);
+    assert(n < max_frames);
+    auto pc = (char*)static_cast<ucontext_t*>(uc)->uc_mcontext.gregs[REG_RIP];
+    auto sw = (char*)&stack_switch_impl;
+    samples++;
+    if (pc >= sw && pc < sw + 32) {
+        in_switch++;
+        // handler, signal frame, switch, caller, ...
+        if (n < 5) in_switch_truncated++;
+    }
+}
+
+int main() {
+    void * warmup[1];
+    backtrace(warmup, 1); // load the unwinder outside of the handler
+
+    {
+        // a stack full of garbage, as a recycled one may be
+        struct dirty_allocator : default_stack_allocator {
+            void * allocate(size_t size = stack_size) {
+                void * p = default_stack_allocator::allocate(size);
+                std::size_t n = size < 65536 ? size : 65536;
+                std::memset((char*)p + size - n, 0xab, n);
+                return p;
+            }
+        };
+        int n = 0;
+        void * frames[max_frames];
+        auto c = callcc(std::allocator_arg, dirty_allocator(),
+                        [&](continuation<void()> c) {
+                            n = deep_backtrace(20, frames);
+                            return c;
+                        });
+        check_backtrace(n, frames, 20);
+    }
+    {
+        // from a resumed continuation
+        int n = 0;
+        void * frames[max_frames];
+        auto c = callcc([&](continuation<void()> c) {
+                c();
+                n = deep_backtrace(20, frames);
+                return c;
+            });
+        c();
+        check_backtrace(n, frames, 20);
+    }
+    {
+        // deferred start and pooled fibers
+        int n = 0;
+        void * frames[max_frames];
+        auto c = callcc(deferred_start, [&](continuation<void()> c) {
+                n = deep_backtrace(20, frames);
+                return c;
+            });
+        c();
+        check_backtrace(n, frames, 20);
+
+        fiber_pool<> fibers;
+        for (int i = 0; i < 2; ++i) {
+            n = 0;
+            fibers.callcc([&](continuation<void()> c) {
+                    n = deep_backtrace(20, frames);
+                    return c;
+                });
+            check_backtrace(n, frames, 20);
+        }
+    }
+#ifndef GPD_INLINE_SWITCH
+    {
+        // asynchronous unwinding from anywhere, including the middle
+        // of a switch, as a sampling profiler does. Not supported by
+        // the inline asm backend.
+        struct sigaction sa;
+        std::memset(&sa, 0, sizeof sa);
+        sa.sa_sigaction = &on_sample;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigaction(SIGPROF, &sa, 0);
+        itimerval timer = { { 0, 200 }, { 0, 200 } };
+        setitimer(ITIMER_PROF, &timer, 0);
+
+        auto c = callcc([](continuation<void()> c) {
+                while (true) c();
+                return c;
+            });
+        // until enough samples hit the switch itself; the bound only
+        // guards against hanging if none ever does
+        while ((samples < 500 || in_switch < 10) && samples < 1000000)
+            c();
+
+        timer = itimerval();
+        setitimer(ITIMER_PROF, &timer, 0);
+        assert(in_switch >= 10);
+        assert(in_switch_truncated == 0);
+    }
+#endif
+}
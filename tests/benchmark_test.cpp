@@ -1,4 +1,6 @@
 #include "continuation.hpp"
+#include "task.hpp"
+#include "fiber_pool.hpp"
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -15,6 +17,16 @@ void traverse(C& out, int depth)
         traverse(out, depth - 1);
 }
 
+// Recurse 'depth' frames, then yield until cancelled.
+template<class C>
+void park_deep(C& out, int depth)
+{
+    if (depth > 0)
+        park_deep(out, depth - 1);
+    else
+        while (out) out(depth);
+}
+
 int main(int argc, char*argv[])
 {
     int depth = 
@@ -35,8 +47,91 @@ int main(int argc, char*argv[])
             }
         }
     }
-        
 
+#ifdef GPD_SHARED_STACK
+    // Sustained switching through 'rounds' traversals, on a dedicated
+    // stack and on a copy-on-park shared stack, where each switch also
+    // copies the live stack slice out and back in.
+    {
+        const int rounds = 100000;
+        auto body = [depth, rounds](continuation<void(int)> c) {
+            for (int r = 0; r < rounds; ++r)
+                traverse(c, depth);
+            return c;
+        };
+        for (int i = 0; i < 4; ++i)
+        {
+            bool shared = i % 2;
+            std::cout << (shared ? "shared" : "dedicated") << " stack, "
+                      << 2 * rounds * (depth + 1) << " switches:\n";
+            auto c = shared ? callcc(shared_stack, body) : callcc(body);
+            boost::timer::auto_cpu_timer t;
+            while(c)
+            {
+                c();
+            }
+        }
+    }
+#endif
+
+    // Short lived continuations, on a new stack each and on pooled
+    // fibers.
+    {
+        const int count = 100000;
+        fiber_pool<> fibers;
+        for (int i = 0; i < 4; ++i)
+        {
+            bool pooled = i % 2;
+            std::cout << (pooled ? "pooled" : "unpooled") << " callcc:\n";
+            boost::timer::auto_cpu_timer t;
+            for (int j = 0; j < count; ++j) {
+                auto f = [](continuation<void()> c) { return c; };
+                auto c = pooled ? fibers.callcc(f) : callcc(f);
+            }
+        }
+    }
+
+    // Mass cancellation of parked generators, a few frames deep: forced
+    // exit via exception (destructor) vs cooperative cancel().
+    {
+        const int count = 10000;
+        for (int i = 0; i < 4; ++i)
+        {
+            bool cooperative = i % 2;
+            std::vector<continuation<int()>> v;
+            for (int j = 0; j < count; ++j)
+                v.push_back(callcc([](continuation<void(int)> c) {
+                            park_deep(c, 10);
+                            return c;
+                        }));
+            std::cout << (cooperative ? "cancel" : "destroy")
+                      << " parked continuations:\n";
+            boost::timer::auto_cpu_timer t;
+            if (cooperative)
+                for (auto& c : v) cancel(std::move(c));
+            v.clear();
+        }
+    }
 
+    // Spawning short non-suspending tasks on a scheduler, with and
+    // without a stack.
+    {
+        auto& sched = *start_background_scheduler().get();
+        const int count = 100000;
+        for (int i = 0; i < 4; ++i)
+        {
+            bool is_stackless = i % 2;
+            std::cout << (is_stackless ? "stackless" : "stackful") << " async:\n";
+            std::vector<future<int>> results;
+            results.reserve(count);
+            boost::timer::auto_cpu_timer t;
+            for (int j = 0; j < count; ++j)
+                results.push_back(is_stackless
+                                  ? async(sched, stackless, [j] { return j; })
+                                  : async(sched, [j] { return j; }));
+            for (auto& x : results)
+                x.get();
+        }
+    }
 }
  
@@ -1,7 +1,10 @@
 #include "continuation.hpp"
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <memory>
 struct noncopyable {
     noncopyable(const noncopyable&) = delete;
     noncopyable(noncopyable&&rhs) : live(rhs.live) { rhs.live = false; }
@@ -60,6 +63,23 @@ int main() {
         assert(c);
         c();
     }
+    {
+        auto c = callcc(small_stack, [](continuation<void(int)> c, int x) {
+                c(x);
+                return c;
+            }, 42);
+        assert(c.get() == 42);
+        c();
+    }
+    {
+        auto c = callcc<int()>(stack_size_t{32*1024}, 
+                               [](continuation<void(int)> c) { 
+                c(42);
+                return c;
+            });
+        assert(c.get() == 42);
+        c();
+    }
 
     {
         auto c = callcc([](continuation<void(noncopyable)> c) { 
@@ -554,4 +574,180 @@ int main() {
                   begin(pipeline));
     }
 
+    {
+        bool started = false;
+        auto c = callcc(deferred_start, [&](continuation<int()> c) {
+                started = true;
+                assert(c.get() == 42);
+                c();
+                assert(c.get() == 43);
+                return c;
+            });
+        assert(!started);
+        c(42);
+        assert(started);
+        c(43);
+        assert(!c);
+    }
+    {
+        auto p = std::make_shared<int>(0);
+        {
+            auto c = callcc<void()>(deferred_start, [p](continuation<void()> c) {
+                    assert(false);
+                    return c;
+                });
+            assert(p.use_count() == 2);
+        }
+        assert(p.use_count() == 1);
+    }
+    {
+        // interrupting an unstarted continuation starts it when the
+        // interrupting function returns
+        int x = 0;
+        auto c = callcc(deferred_start, [&](continuation<void()> c) {
+                x += 1;
+                return c;
+            });
+        c = callcc(std::move(c), [&](continuation<void()> c) {
+                x = 10;
+                return c;
+            });
+        assert(x == 11);
+        assert(!c);
+    }
+    {
+        // the interrupting function runs on an aligned stack: varargs
+        // with doubles use aligned SSE stores
+        volatile double x = 1.5;
+        char buf[16] = {};
+        auto c = callcc(deferred_start, [](continuation<void()> c) {
+                return c;
+            });
+        c = callcc(std::move(c), [&](continuation<void()> c) {
+                std::snprintf(buf, sizeof buf, "%f", x);
+                return c;
+            });
+        assert(std::strcmp(buf, "1.500000") == 0);
+        assert(!c);
+    }
+    {
+        // small trivially copyable values, including zero, are passed
+        // in registers
+        auto c = callcc([](continuation<void(int)> c) {
+                for (int x : { 0, -1, 7, 0 })
+                    c(x);
+                return c;
+            });
+        std::vector<int> r(begin(c), end(c));
+        assert((r == std::vector<int>{ 0, -1, 7, 0 }));
+
+        auto f = callcc([](continuation<void(float)> c) {
+                c(0.f); c(-2.5f);
+                return c;
+            });
+        assert(f.get() == 0.f);
+        f();
+        assert(f.get() == -2.5f);
+        f();
+        assert(!f);
+
+        auto b = callcc([](continuation<void(bool)> c) {
+                c(false);
+                return c;
+            });
+        assert(b && b.get() == false);
+        b();
+    }
+    {
+        // larger values, references and move only values are passed
+        // by pointer
+        struct big { long x[16]; };
+        auto c = callcc([](continuation<void(big)> c) {
+                big b {};
+                b.x[15] = 42;
+                c(b);
+                return c;
+            });
+        assert(c.get().x[15] == 42);
+        c();
+
+        int target = 0;
+        auto r = callcc([&](continuation<void(int&)> c) {
+                c(target);
+                return c;
+            });
+        assert(&r.get() == &target);
+        r();
+
+        auto m = callcc([](continuation<void(std::unique_ptr<int>)> c) {
+                c(std::unique_ptr<int>(new int(3)));
+                return c;
+            });
+        auto p = m.get();
+        assert(*p == 3);
+        m();
+
+        auto t = callcc([](continuation<void(int, long)> c) {
+                c(1, 2);
+                return c;
+            });
+        assert(std::get<1>(t.get()) == 2);
+        t();
+    }
+    {
+        // a cooperating context is cancelled without exceptions
+        struct tracker {
+            int& n;
+            ~tracker() { n++; }
+        };
+        int destroyed = 0;
+        bool unwound = false;
+        auto c = callcc([&](continuation<void(int)> c) {
+                tracker t { destroyed };
+                try {
+                    for (int i = 0; c; ++i)
+                        c(i);
+                } catch(...) {
+                    unwound = true;
+                    throw;
+                }
+                assert(c.cancelled() && !c.has_data());
+                return c;
+            });
+        assert(c.get() == 0);
+        c();
+        assert(c.get() == 1);
+        cancel(std::move(c));
+        assert(destroyed == 1);
+        assert(!unwound);
+    }
+    {
+        // a context switching to a cancelled continuation is forced
+        // to exit
+        int destroyed = 0;
+        struct tracker {
+            int& n;
+            ~tracker() { n++; }
+        };
+        auto c = callcc([&](continuation<void(int)> c) {
+                tracker t { destroyed };
+                c(1);
+                c(2);
+                assert(false);
+                return c;
+            });
+        cancel(std::move(c));
+        assert(destroyed == 1);
+    }
+    {
+        // unstarted contexts are destroyed without running the functor
+        bool run = false;
+        auto c = callcc(deferred_start, [&](continuation<void()> c) {
+                run = true;
+                return c;
+            });
+        cancel(std::move(c));
+        assert(!run);
+    }
+
 }
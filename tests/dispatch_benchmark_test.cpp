@@ -0,0 +1,85 @@
+#include "future.hpp"
+#include "futex_waiter.hpp"
+#include "task.hpp"
+#include <chrono>
+#include <iostream>
+#include <new>
+
+using namespace gpd;
+
+typedef std::chrono::steady_clock clock_type;
+
+double ns(clock_type::duration d) {
+    return std::chrono::duration<double, std::nano>(d).count();
+}
+
+const int rounds = 2000000;
+
+// Signal an event waited by a latch which does not need to sleep:
+// try_wait, signal, wait.
+void latch() {
+    futex_waiter w;
+    event e;
+    auto t0 = clock_type::now();
+    for (int i = 0; i < rounds; ++i) {
+        e.~event();
+        new (&e) event;
+        w.reset();
+        if (e.try_wait(&w)) {
+            e.signal();
+            w.wait(1);
+        }
+    }
+    std::cout << "signal into a futex_waiter: "
+              << ns(clock_type::now() - t0) / rounds << " ns\n";
+}
+
+// Set the value of promises whose future has been dropped: the
+// shared state is deleted by the signal.
+void dropped() {
+    auto t0 = clock_type::now();
+    for (int i = 0; i < rounds; ++i) {
+        promise<int> p;
+        p.get_future();
+        p.set_value(i);
+    }
+    std::cout << "set_value, future dropped: "
+              << ns(clock_type::now() - t0) / rounds << " ns\n";
+}
+
+// Two tasks on one scheduler, each waiting for the other's promise in
+// turn: the signal goes through the waiter of the task.
+void ping_pong() {
+    const int n = rounds / 10;
+    auto& sched = *start_background_scheduler().get();
+    auto elapsed = async(sched, [n] {
+            std::vector<promise<int> > ping(n), pong(n);
+            std::vector<future<int> > ping_f, pong_f;
+            for (int i = 0; i < n; ++i) {
+                ping_f.push_back(ping[i].get_future());
+                pong_f.push_back(pong[i].get_future());
+            }
+            auto t0 = clock_type::now();
+            auto other = async(pool, [&] {
+                    for (int i = 0; i < n; ++i) {
+                        gpd::wait(pool, ping_f[i]);
+                        pong[i].set_value(ping_f[i].get());
+                    }
+                    return 0;
+                });
+            for (int i = 0; i < n; ++i) {
+                ping[i].set_value(i);
+                gpd::wait(pool, pong_f[i]);
+            }
+            other.get(pool);
+            return clock_type::now() - t0;
+        }).get();
+    std::cout << "task ping-pong on one scheduler: "
+              << ns(elapsed) / n << " ns per round trip\n";
+}
+
+int main() {
+    latch();
+    dropped();
+    ping_pong();
+}
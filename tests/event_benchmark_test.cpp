@@ -0,0 +1,123 @@
+#include "event.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+using namespace gpd;
+
+struct counting_waiter : waiter {
+    std::atomic<std::size_t> count = { 0 };
+    void signal(event_ptr p) override {
+        p.release();
+        count++;
+    }
+};
+
+typedef std::chrono::steady_clock clock_type;
+
+double ns(clock_type::duration d) {
+    return std::chrono::duration<double, std::nano>(d).count();
+}
+
+// Each round, one thread runs wait_many then dismiss_wait_many, the
+// wait_any pattern, on 'n' events while another thread signals all of
+// them.
+template<class Policy>
+void contended(const char * name, std::size_t n) {
+    typedef basic_event<Policy> event_type;
+    const std::size_t rounds = std::max<std::size_t>(100, 200000 / n);
+    std::unique_ptr<event_type[]> events(new event_type[n]);
+    std::vector<event_type*> ptrs;
+    for (std::size_t i = 0; i < n; ++i)
+        ptrs.push_back(&events[i]);
+
+    counting_waiter w;
+    std::atomic<std::size_t> started = { 0 };
+    std::atomic<std::size_t> done = { 0 };
+    clock_type::duration wait_time {}, dismiss_time {}, signal_time {};
+
+    std::thread signaller([&] {
+            for (std::size_t r = 1; r <= rounds; ++r) {
+                while (started.load(std::memory_order_acquire) != r)
+                    std::this_thread::yield();
+                auto t0 = clock_type::now();
+                for (auto e : ptrs)
+                    e->signal();
+                signal_time += clock_type::now() - t0;
+                done.store(r, std::memory_order_release);
+            }
+        });
+
+    for (std::size_t r = 1; r <= rounds; ++r) {
+        for (auto e : ptrs) {
+            e->~event_type();
+            new (e) event_type();
+        }
+        w.count = 0;
+        started.store(r, std::memory_order_release);
+        auto t0 = clock_type::now();
+        auto waited = event_type::wait_many(&w, ptrs.begin(), ptrs.end()).second;
+        auto t1 = clock_type::now();
+        auto dismissed = event_type::dismiss_wait_many(&w, ptrs.begin(), ptrs.end());
+        auto t2 = clock_type::now();
+        wait_time += t1 - t0;
+        dismiss_time += t2 - t1;
+        while (done.load(std::memory_order_acquire) != r)
+            std::this_thread::yield();
+        // every waited event has either been dismissed or fired
+        assert(w.count == waited - dismissed);
+        (void)waited; (void)dismissed;
+    }
+    signaller.join();
+
+    double ops = double(rounds) * n;
+    std::cout << name << ", " << n << " events: "
+              << "wait_many " << ns(wait_time) / ops << " ns/event, "
+              << "dismiss_wait_many " << ns(dismiss_time) / ops << " ns/event, "
+              << "signal " << ns(signal_time) / ops << " ns/event\n";
+}
+
+// Uncontended single event try_wait/dismiss_wait and signal.
+template<class Policy>
+void single(const char * name) {
+    typedef basic_event<Policy> event_type;
+    const int count = 1000000;
+    counting_waiter w;
+    auto t0 = clock_type::now();
+    for (int i = 0; i < count; ++i) {
+        event_type e;
+        bool waited = e.try_wait(&w);
+        bool dismissed = e.dismiss_wait(&w);
+        assert(waited && dismissed);
+        (void)waited; (void)dismissed;
+    }
+    auto t1 = clock_type::now();
+    for (int i = 0; i < count; ++i) {
+        event_type e;
+        e.signal();
+    }
+    auto t2 = clock_type::now();
+    assert(w.count == 0);
+    std::cout << name << ", uncontended: try_wait+dismiss_wait "
+              << ns(t1 - t0) / count << " ns, signal "
+              << ns(t2 - t1) / count << " ns\n";
+}
+
+template<class Policy>
+void run(const char * name) {
+    single<Policy>(name);
+    for (std::size_t n : { 1, 10, 100, 1000 })
+        contended<Policy>(name, n);
+}
+
+int main() {
+    run<waitfree_event_policy>("waitfree");
+    run<dekker_like_event_policy>("dekker-like");
+    run<mixed_atomics_event_policy>("mixed atomics");
+}
@@ -0,0 +1,124 @@
+#define GPD_FIBER_LOCAL
+#include "fiber_local.hpp"
+#include "task.hpp"
+#include <cassert>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace gpd;
+
+fiber_local<int> counter;
+fiber_local<std::string> name([] { return std::string("main"); });
+
+struct tracked {
+    static int live;
+    tracked() { live++; }
+    ~tracked() { live--; }
+};
+int tracked::live = 0;
+fiber_local<tracked> resource;
+
+// The id of the running thread, read anew after each switch: the
+// calls to pthread_self, declared const, would be merged otherwise.
+__attribute__((noinline)) std::thread::id current_thread_id() {
+    asm volatile ("" ::: "memory");
+    return std::this_thread::get_id();
+}
+
+int main() {
+    {
+        // each context has its own instance, lazily initialized
+        *counter = 1;
+        auto c = callcc([](continuation<void()> c) {
+                assert(*counter == 0);
+                assert(*name == "main");
+                *counter = 10;
+                *name = "fiber";
+                c();
+                assert(*counter == 10);
+                assert(*name == "fiber");
+                return c;
+            });
+        assert(*counter == 1);
+        assert(*name == "main");
+        c();
+        assert(!c);
+        assert(*counter == 1);
+    }
+    {
+        // instances are destroyed when the context finishes
+        auto c = callcc([](continuation<void()> c) {
+                resource.get();
+                c();
+                return c;
+            });
+        assert(tracked::live == 1);
+        c();
+        assert(tracked::live == 0);
+
+        // including when it is forced to exit
+        {
+            auto c = callcc([](continuation<void()> c) {
+                    resource.get();
+                    c();
+                    assert(false);
+                    return c;
+                });
+            assert(tracked::live == 1);
+        }
+        assert(tracked::live == 0);
+    }
+    {
+        // nested contexts
+        auto c = callcc([](continuation<void()> c) {
+                *counter = 2;
+                auto inner = callcc([](continuation<void()> c) {
+                        *counter = 3;
+                        c();
+                        assert(*counter == 3);
+                        return c;
+                    });
+                assert(*counter == 2);
+                inner();
+                assert(*counter == 2);
+                return c;
+            });
+        assert(*counter == 1);
+    }
+    {
+        // a pooled fiber gets fresh instances for each job
+        fiber_pool<> fibers;
+        for (int i = 0; i < 2; ++i) {
+            auto c = fibers.callcc([](continuation<void()> c) {
+                    assert(*counter == 0);
+                    *counter = 5;
+                    return c;
+                });
+        }
+        assert(fibers.idle_count() == 1);
+    }
+    {
+        // instances follow tasks across schedulers and threads
+        auto& s1 = *start_background_scheduler().get();
+        auto& s2 = *start_background_scheduler().get();
+        std::vector<future<bool>> v;
+        for (int i = 0; i < 20; ++i)
+            v.push_back(async(s1, [&, i] {
+                        *counter = i;
+                        auto id = current_thread_id();
+                        yield(s2);
+                        bool ok = current_thread_id() != id && *counter == i;
+                        yield(s1);
+                        return ok && *counter == i;
+                    }));
+        v.push_back(async(s1, stackless, [&] {
+                    assert(*counter == 0);
+                    *counter = 42;
+                    yield(s2);
+                    return *counter == 42;
+                }));
+        for (auto& f : v)
+            assert(f.get());
+    }
+}
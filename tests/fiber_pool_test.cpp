@@ -0,0 +1,97 @@
+#include "fiber_pool.hpp"
+#include "task.hpp"
+#include <cassert>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace gpd;
+
+int main() {
+    {
+        fiber_pool<> fibers;
+        for (int i = 0; i < 3; ++i) {
+            auto c = fibers.callcc([](continuation<void(int)> c) {
+                    for (int j = 0; j < 3; ++j)
+                        c(j);
+                    return c;
+                });
+            assert(fibers.idle_count() == 0);
+            int expected = 0;
+            while (c) {
+                assert(c.get() == expected++);
+                c();
+            }
+            assert(expected == 3);
+            // the finished fiber is back in the pool
+            assert(fibers.idle_count() == 1);
+        }
+    }
+    {
+        // arguments are bound as with callcc
+        fiber_pool<> fibers;
+        int x = 0;
+        auto c = fibers.callcc([](continuation<void()> c, int& x, int y) {
+                x = y;
+                return c;
+            }, std::ref(x), 42);
+        assert(!c);
+        assert(x == 42);
+    }
+    {
+        // destroying an unfinished continuation returns the fiber
+        fiber_pool<> fibers;
+        {
+            auto c = fibers.callcc([](continuation<void()> c) {
+                    c();
+                    assert(false);
+                    return c;
+                });
+            assert(c);
+        }
+        assert(fibers.idle_count() == 1);
+    }
+    {
+        // at most max_idle idle fibers are kept
+        fiber_pool<> fibers(1);
+        auto c1 = fibers.callcc([](continuation<void()> c) { c(); return c; });
+        auto c2 = fibers.callcc([](continuation<void()> c) { c(); return c; });
+        c1();
+        c2();
+        assert(!c1 && !c2);
+        assert(fibers.idle_count() == 1);
+        fibers.trim(0);
+        assert(fibers.idle_count() == 0);
+    }
+    {
+        // fibers may still be finishing when the futures are ready; the
+        // pool waits for them on destruction
+        fiber_pool<> fibers(4);
+        auto& sched = *start_background_scheduler().get();
+        std::vector<future<int>> v;
+        for (int i = 0; i < 100; ++i)
+            v.push_back(async(sched, fibers, [i] { yield(); return i; }));
+        auto v1 = async(sched, [&] {
+                return async(pool, fibers, [] { return 1; }).get(pool);
+            });
+        for (int i = 0; i < 100; ++i)
+            assert(v[i].get() == i);
+        assert(v1.get() == 1);
+    }
+    {
+        // the destructor blocks until a job finishing on another
+        // thread gives its fiber back
+        continuation<void()> job;
+        std::thread finisher;
+        {
+            fiber_pool<> fibers;
+            job = fibers.callcc([](continuation<void()> c) { c(); return c; });
+            finisher = std::thread([&] {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                    job();
+                });
+        }
+        finisher.join();
+        assert(!job);
+    }
+}
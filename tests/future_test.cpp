@@ -4,16 +4,71 @@
 #include "cv_waiter.hpp"
 #include "fd_waiter.hpp"
 #include "futex_waiter.hpp"
+#include "futexv_waiter.hpp"
 #include "sem_waiter.hpp"
+#include "wait_set.hpp"
 #include "continuation.hpp"
 #include "task.hpp"
+#include "fiber_pool.hpp"
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <functional>
+#include <thread>
 #include <unistd.h>
 #include <algorithm>
+#include <vector>
+
+// Stacks whose deallocation, run by trampolines on top of the context
+// a finishing fiber switches to, needs an aligned stack: varargs with
+// doubles use aligned SSE stores.
+struct sse_stack_allocator : gpd::default_stack_allocator {
+    void deallocate(void * p) throw() {
+        char buf[16];
+        volatile double x = 1.5;
+        std::snprintf(buf, sizeof buf, "%f", x);
+        assert(std::strcmp(buf, "1.500000") == 0);
+        gpd::default_stack_allocator::deallocate(p);
+    }
+};
+
+// A Waitable which must not be touched once dead.
+struct checked_member {
+    gpd::event e;
+    bool alive = true;
+    friend gpd::event * get_event(checked_member& m) {
+        assert(m.alive);
+        return &m.e;
+    }
+};
 
 int main() {
     using namespace gpd;
+    {
+        // each task ties up the scheduler sleeper with a suspended
+        // stackless task, so that it finishes into a new, unstarted
+        // one; the fiber is destroyed on top of it
+        auto& sched = *start_background_scheduler().get();
+        fiber_pool<sse_stack_allocator> fibers(0);
+        const int n = 20;
+        std::vector<promise<int>> holds(n);
+        std::vector<future<int>> held(n);
+        for (int i = 0; i < n; ++i) {
+            auto f = async(sched, fibers, [&, i] {
+                    held[i] = async(pool, stackless, [f = holds[i].get_future()]() mutable {
+                            return f.get(pool);
+                        });
+                    yield();
+                    return i;
+                });
+            assert(f.get() == i);
+        }
+        for (int i = 0; i < n; ++i) {
+            holds[i].set_value(i);
+            assert(held[i].get() == i);
+        }
+    }
     {
         promise<int> callback;
 
@@ -159,7 +214,14 @@ int main() {
         gpd::future<int> f[] = { launch(), launch(), launch(), launch() };
         while (std::any_of(std::begin(f), std::end(f),
                            [](auto&& f) { return !f.ready(); })) {
-            wait_any(strategy, f);
+            auto i = wait_any(strategy, f);
+            assert(f[i].ready());
+            std::vector<bool> ready;
+            auto n = wait_any_ready(strategy, ready, f);
+            assert(ready.size() == 4 && ready[i] &&
+                   n == std::size_t(std::count(ready.begin(), ready.end(), true)));
+            for (std::size_t j = 0; j < ready.size(); ++j)
+                assert(!ready[j] || f[j].ready());
         }
     };
 
@@ -184,6 +246,84 @@ int main() {
         sem_waiter waiter;
         test(waiter);
     }
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        adaptive_waiter waiter;
+        test(waiter);
+    }
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        futexv_waiter waiter;
+        test(waiter);
+    }
+
+    auto timed_test = [&](auto& strategy) {
+        using namespace std::chrono;
+        {
+            // a timed out future can be waited again
+            promise<int> p;
+            auto f = p.get_future();
+            assert(f.wait_for(milliseconds(1), strategy) == std::future_status::timeout);
+            assert(wait_until(strategy, system_clock::now() + milliseconds(1), f) ==
+                   std::future_status::timeout);
+            p.set_value(1);
+            assert(f.wait_for(seconds(0), strategy) == std::future_status::ready);
+            assert(f.get(strategy) == 1);
+        }
+        {
+            promise<int> p1, p2;
+            future<int> f[] = { p1.get_future(), p2.get_future() };
+            assert(wait_any_for(strategy, milliseconds(1), f) ==
+                   std::future_status::timeout);
+            p2.set_value(2);
+            assert(wait_any_for(strategy, seconds(10), f) == std::future_status::ready);
+            assert(wait_all_for(strategy, milliseconds(1), f[0], f[1]) ==
+                   std::future_status::timeout);
+            p1.set_value(1);
+            assert(wait_all_for(strategy, seconds(10), f[0], f[1]) ==
+                   std::future_status::ready);
+            assert(f[0].get() + f[1].get() == 3);
+        }
+        // values set around the deadline
+        for (int i = 0; i < 200; ++i) {
+            promise<int> p1, p2;
+            future<int> f[] = { p1.get_future(), p2.get_future() };
+            std::thread th([&] { p1.set_value(1); p2.set_value(2); });
+            auto status = wait_any_for(strategy, microseconds(i % 20 * 10), f);
+            assert(status == std::future_status::timeout ||
+                   f[0].ready() || f[1].ready());
+            status = wait_all_for(strategy, microseconds(i % 20 * 10), f);
+            assert(status == std::future_status::timeout ||
+                   (f[0].ready() && f[1].ready()));
+            th.join();
+            assert(wait_all_for(strategy, seconds(10), f) == std::future_status::ready);
+            assert(f[0].get() + f[1].get() == 3);
+        }
+    };
+    {
+        cv_waiter waiter;
+        timed_test(waiter);
+    }
+    {
+        fd_waiter waiter;
+        timed_test(waiter);
+    }
+    {
+        futex_waiter waiter;
+        timed_test(waiter);
+    }
+    {
+        sem_waiter waiter;
+        timed_test(waiter);
+    }
+    {
+        adaptive_waiter waiter;
+        timed_test(waiter);
+    }
+    {
+        futexv_waiter waiter;
+        timed_test(waiter);
+    }
     {
         sem_waiter waiter;
         auto& sched = *start_background_scheduler().get();
@@ -207,11 +347,60 @@ int main() {
                 return c4.get(pool);
             });
         
-        wait_all(waiter, v1, v2, v3);
+        set_stack_size(sched, medium_stack);
+        auto v4 = async(sched, small_stack, []{ yield(); return 1; });
+        auto v5 = async(sched, []{ return async(pool, small_stack, [] { return 2; }).get(pool); });
+
+        wait_all(waiter, v1, v2, v3, v4, v5);
+        assert(v4.get() == 1);
+        assert(v5.get() == 2);
         assert(v1.get() == 42);
         assert(v2.get() == 47);
         assert(v3.get() == 52);
     }
+    {
+        sem_waiter waiter;
+        auto& sched = *start_background_scheduler().get();
+        auto v1 = async(sched, stackless, []{ return 1; });
+        // suspending stackless tasks
+        auto v2 = async(sched, stackless, []{ yield(); return 2; });
+        auto v3 = async(sched, stackless, []{
+                auto c1 = async(pool, stackless, [] { yield(); return 3; });
+                auto c2 = async(pool, [] { yield(); return 4; });
+                return c1.get(pool) + c2.get(pool);
+            });
+        std::vector<future<int>> v;
+        for (int i = 0; i < 100; ++i)
+            v.push_back(async(sched, stackless, [i]{ return i; }));
+        wait_all(waiter, v1, v2, v3);
+        assert(v1.get() == 1);
+        assert(v2.get() == 2);
+        assert(v3.get() == 7);
+        for (int i = 0; i < 100; ++i)
+            assert(v[i].get() == i);
+        // stackless tasks queued by a task on a small stack are not run
+        // on that stack when it finishes; the idle stack is tied up
+        // first, so that nothing else is queued
+        promise<int> hold;
+        auto held = async(sched, stackless, [f = hold.get_future()]() mutable {
+                return f.get(pool);
+            });
+        fiber_pool<sized_stack_allocator<mmap_stack_allocator<>>> small_fibers(1, small_stack);
+        auto v4 = async(sched, small_fibers, [] {
+                std::vector<future<int>> v;
+                for (int i = 0; i < 4; ++i)
+                    v.push_back(async(pool, stackless, [i] {
+                                volatile char buf[64*1024];
+                                for (auto& c : buf) c = i;
+                                return buf[0] + buf[sizeof buf - 1];
+                            }));
+                return v;
+            }).get();
+        for (int i = 0; i < 4; ++i)
+            assert(v4[i].get() == 2*i);
+        hold.set_value(5);
+        assert(held.get() == 5);
+    }
     {
         auto p = promise<int>{} ;
         auto fut = p.get_future().share();
@@ -235,4 +424,293 @@ int main() {
         assert(g.get() == 52);
             
     }
+    {
+        // fan out to many copies, some dropped before the value
+        promise<int> p;
+        auto f = p.get_future().share();
+        std::vector<shared_future<int> > copies(100, f);
+        for (std::size_t i = 0; i < copies.size(); i += 3)
+            copies[i] = shared_future<int>();
+        copies.erase(copies.begin() + 10, copies.begin() + 20);
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i)
+            readers.emplace_back([f] () mutable { assert(f.get() == 42); });
+        assert(!copies[1].ready());
+        p.set_value(42);
+        for (auto& t : readers)
+            t.join();
+        for (auto& c : copies)
+            assert(!c.valid() || (c.ready() && c.get() == 42));
+        shared_future<int> late = f;
+        assert(late.ready() && late.get() == 42);
+    }
+    {
+        // wait_any over shared and plain futures
+        promise<int> p1, p2;
+        auto s = p1.get_future().share();
+        auto s2 = s;
+        auto f = p2.get_future();
+        std::thread th([&] { p1.set_value(1); });
+        futex_waiter w;
+        while (!s2.ready())
+            wait_any(w, s2, f);
+        th.join();
+        assert(s2.get() == 1 && s.get() == 1);
+        p2.set_value(2);
+        assert(f.get() == 2);
+    }
+    {
+        // wait_any reports which Waitables are ready
+        promise<int> p1, p2, p3;
+        auto f1 = p1.get_future(), f2 = p2.get_future(), f3 = p3.get_future();
+        p2.set_value(2);
+        futex_waiter w;
+        assert(wait_any(w, f1, f2, f3) == 1);
+        std::vector<event*> fs = { get_event(f1), get_event(f2), get_event(f3) };
+        std::thread th([&] { p3.set_value(3); });
+        auto& sched = *start_background_scheduler().get();
+        auto ready = async(sched, [&] {
+                std::vector<bool> ready;
+                gpd::wait(pool, f3);
+                wait_any_ready(pool, ready, fs);
+                return ready;
+            }).get();
+        th.join();
+        assert((ready == std::vector<bool>{ false, true, true }));
+        p1.set_value(1);
+        assert(wait_any(w, f3, f1) == 0);
+    }
+    {
+        // quorum waits: the first k of n, the rest dismissed
+        std::vector<promise<int> > ps(5);
+        std::vector<future<int> > fs;
+        for (auto& p : ps)
+            fs.push_back(p.get_future());
+        ps[4].set_value(4);
+        std::thread th([&] { ps[1].set_value(1); ps[2].set_value(2); });
+        fd_waiter w;
+        std::vector<bool> ready;
+        auto n = wait_some(w, 3, ready, fs);
+        th.join();
+        assert(n == 3 && (ready == std::vector<bool>{ false, true, true, false, true }));
+        assert(wait_some(w, 1, fs) == 3);
+        std::vector<event*> es = { get_event(fs[0]), get_event(fs[3]) };
+        auto& sched = *start_background_scheduler().get();
+        auto quorum = async(sched, [&] { return wait_some(pool, 2, es); });
+        ps[3].set_value(3);
+        ps[0].set_value(0);
+        assert(quorum.get() == 2);
+        for (std::size_t i = 0; i < fs.size(); ++i)
+            assert(fs[i].get() == int(i));
+    }
+    for (int i = 0; i < 200; ++i) {
+        // when_some racing with the replies, the rest dropped
+        const std::size_t n = 6, k = 2 + i % 3;
+        std::vector<promise<int> > ps(n);
+        std::vector<future<int> > fs;
+        for (auto& p : ps)
+            fs.push_back(p.get_future());
+        if (i % 2)
+            ps[i % n].set_value(i % n);
+        std::vector<std::thread> replies;
+        for (std::size_t j = 0; j < n; ++j)
+            if (!(i % 2 && j == i % n))
+                replies.emplace_back([&ps, j] { ps[j].set_value(j); });
+        auto r = when_some(k, std::move(fs)).get();
+        assert(r.indexes.size() >= k && r.futures.size() == n);
+        assert(std::is_sorted(r.indexes.begin(), r.indexes.end()));
+        for (auto j : r.indexes)
+            assert(r.futures[j].get() == int(j));
+        r.futures.clear();
+        for (auto& t : replies)
+            t.join();
+    }
+    {
+        // batched completion into two thread waiters
+        std::vector<promise<int> > ps(100);
+        std::vector<future<int> > fs1, fs2;
+        for (std::size_t i = 0; i < ps.size(); ++i)
+            (i % 2 ? fs1 : fs2).push_back(ps[i].get_future());
+        std::thread t1([&] { fd_waiter w; wait_all(w, fs1); });
+        std::thread t2([&] { futex_waiter w; wait_all(w, fs2); });
+        std::vector<int> values(ps.size());
+        for (std::size_t i = 0; i < values.size(); ++i)
+            values[i] = i;
+        set_values(ps.begin(), ps.end(), values.begin());
+        t1.join();
+        t2.join();
+        for (std::size_t i = 0; i < ps.size(); ++i)
+            assert((i % 2 ? fs1 : fs2)[i / 2].get() == int(i));
+        promise<int> done;
+        int one = 1;
+        try {
+            set_values(&done, &done + 1, &one);
+            set_values(&done, &done + 1, &one);
+            assert(false);
+        } catch (std::future_error&) {}
+    }
+    {
+        // batched completion into tasks parked on a scheduler
+        auto& sched = *start_background_scheduler().get();
+        std::vector<promise<int> > ps(50);
+        std::vector<future<int> > results;
+        for (auto& p : ps)
+            results.push_back(async(sched, [f = p.get_future()] () mutable {
+                        gpd::wait(pool, f);
+                        return f.get() * 2;
+                    }));
+        std::vector<int> values(ps.size(), 21);
+        set_values(ps.begin(), ps.end(), values.begin());
+        for (auto& r : results)
+            assert(r.get() == 42);
+    }
+    {
+        // batched completion into a context resumed in place: it runs
+        // out of the batch, so that the post of the remote task it
+        // wakes up is not deferred until the batch ends
+        auto& sched = *start_background_scheduler().get();
+        promise<int> p0, p1, p2, p3;
+        auto f1 = p1.get_future();
+        auto f3 = p3.get_future();
+        auto remote = async(sched, [f2 = p2.get_future(), &p0, &p3] () mutable {
+                p0.set_value(0);
+                p3.set_value(f2.get(pool) + 1);
+                return 0;
+            });
+        // let the remote task park on f2
+        p0.get_future().get();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        auto c = callcc([&](task_t producer) {
+                using gpd::wait;
+                wait(producer, f1);
+                p2.set_value(41);
+                assert(f3.get() == 42);
+                return producer;
+            });
+        assert(!c);
+        int one = 1;
+        set_values(&p1, &p1 + 1, &one);
+        assert(f1.get() == 1);
+        assert(remote.get() == 0);
+    }
+    {
+        // persistent wait_set: delivery order, rearm, remove, timeout
+        std::vector<promise<int> > ps(8);
+        std::vector<future<int> > fs;
+        for (auto& p : ps)
+            fs.push_back(p.get_future());
+        wait_set set;
+        std::vector<wait_set::key_type> keys;
+        for (auto& f : fs)
+            keys.push_back(set.add(f));
+        futex_waiter w;
+        assert(wait_for(w, std::chrono::milliseconds(1), set) ==
+               std::future_status::timeout);
+        ps[5].set_value(5);
+        ps[3].set_value(3);
+        std::vector<wait_set::key_type> ready;
+        wait(w, set);
+        set.take_ready(std::back_inserter(ready));
+        assert((ready == std::vector<wait_set::key_type>{ keys[5], keys[3] }));
+        assert(!set.ready());
+        ps[3] = promise<int>();
+        fs[3] = ps[3].get_future();
+        set.rearm(keys[3]);
+        set.remove(keys[5]);
+        assert(fs[5].get() == 5);
+        set.remove(keys[0]);
+        fs[0] = future<int>();
+        assert(set.add(fs[0] = future<int>(0)) == keys[0] && set.ready());
+        std::thread th([&] { ps[3].set_value(33); });
+        ready.clear();
+        while (ready.size() < 2) {
+            wait(w, set);
+            set.take_ready(std::back_inserter(ready));
+        }
+        th.join();
+        std::sort(ready.begin(), ready.end());
+        assert((ready == std::vector<wait_set::key_type>{ keys[0], keys[3] }));
+        assert(fs[3].get() == 33);
+        // members still waited are dismissed by the destructor
+    }
+    {
+        // a member removed while being signaled, then destroyed: the
+        // destructor waits for the signal without touching it
+        checked_member m;
+        std::thread th;
+        {
+            wait_set set;
+            auto key = set.add(m);
+            // as a concurrent set_value: marked, not yet delivered
+            auto w = get_event(m)->mark_signaled();
+            assert(w);
+            set.remove(key);
+            m.alive = false;
+            th = std::thread([w, &m] {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    w->notify(&m.e);
+                });
+        }
+        th.join();
+    }
+    {
+        // wait_set in a task, fed by another thread, with removals
+        const std::size_t n = 300;
+        std::vector<promise<int> > ps(n);
+        std::vector<future<int> > fs;
+        for (auto& p : ps)
+            fs.push_back(p.get_future());
+        auto& sched = *start_background_scheduler().get();
+        auto seen = async(sched, [&] {
+                wait_set set;
+                std::vector<wait_set::key_type> keys, ready;
+                for (auto& f : fs)
+                    keys.push_back(set.add(f));
+                std::vector<int> count(n);
+                for (std::size_t i = 0; i < n; i += 10)
+                    set.remove(keys[i]);
+                std::size_t left = n - n / 10;
+                while (left) {
+                    gpd::wait(pool, set);
+                    ready.clear();
+                    set.take_ready(std::back_inserter(ready));
+                    for (auto k : ready) {
+                        assert(k % 10 && fs[k].get() == int(k));
+                        ++count[k];
+                        --left;
+                    }
+                }
+                return std::count(count.begin(), count.end(), 1);
+            });
+        std::thread th([&] {
+                for (std::size_t i = 0; i < n; ++i)
+                    ps[i].set_value(i);
+            });
+        assert(std::size_t(seen.get()) == n - n / 10);
+        th.join();
+    }
+    for (int i = 0; i < 100; ++i) {
+        // copies made and dropped while the value is set
+        promise<int> p;
+        auto f = p.get_future().share();
+        std::atomic<bool> stop = { false };
+        std::vector<std::thread> churn;
+        for (int j = 0; j < 2; ++j)
+            churn.emplace_back([f, &stop] {
+                    while (!stop) {
+                        shared_future<int> a = f, b = a;
+                        b = shared_future<int>();
+                        if (a.ready())
+                            assert(a.get() == 7);
+                        std::this_thread::yield();
+                    }
+                    shared_future<int> c = f;
+                    assert(c.get() == 7);
+                });
+        std::this_thread::yield();
+        p.set_value(7);
+        stop = true;
+        for (auto& t : churn)
+            t.join();
+    }
 }
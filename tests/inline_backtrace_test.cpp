@@ -0,0 +1,2 @@
+#define GPD_INLINE_SWITCH
+#include "backtrace_test.cpp"
@@ -0,0 +1,3 @@
+// The shared stack tests, on the inline asm switch backend.
+#define GPD_INLINE_SWITCH
+#include "shared_stack_test.cpp"
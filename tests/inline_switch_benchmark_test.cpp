@@ -0,0 +1,3 @@
+// Switch latency of the inline asm switch backend.
+#define GPD_INLINE_SWITCH
+#include "switch_benchmark_test.cpp"
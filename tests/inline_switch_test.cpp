@@ -0,0 +1,3 @@
+// The continuation tests, on the inline asm switch backend.
+#define GPD_INLINE_SWITCH
+#include "continuation_test.cpp"
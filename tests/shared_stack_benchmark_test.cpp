@@ -0,0 +1,3 @@
+// The benchmarks, including the shared stack ones.
+#define GPD_SHARED_STACK
+#include "benchmark_test.cpp"
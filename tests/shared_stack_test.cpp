@@ -0,0 +1,121 @@
+#define GPD_SHARED_STACK
+#include "continuation.hpp"
+#include <cassert>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+using namespace gpd;
+
+// Use some stack, so that slices are not trivially small.
+int __attribute__((noinline)) deep(int depth) {
+    volatile char buf[512];
+    buf[0] = depth;
+    return depth == 0 ? buf[0] : deep(depth - 1) + buf[0];
+}
+
+int main() {
+    {
+        auto c = callcc(shared_stack, [](continuation<void(int)> c) {
+                for (int i = 0; i < 10; ++i)
+                    c(i);
+                return c;
+            });
+        int j = 0;
+        for (; c; c())
+            assert(c.get() == j++);
+        assert(j == 10);
+    }
+    {
+        // many parked generators sharing the same stack
+        std::vector<continuation<int()> > gens;
+        for (int i = 0; i < 100; ++i)
+            gens.push_back(callcc(shared_stack, [i](continuation<void(int)> c) {
+                        int local = i;
+                        for (int k = 0; k < 5; ++k) {
+                            deep(k);
+                            c(local + k);
+                        }
+                        return c;
+                    }));
+        for (int k = 0; k < 5; ++k)
+            for (int i = 0; i < 100; ++i) {
+                assert(gens[i].get() == i + k);
+                gens[i]();
+            }
+        for (auto& g : gens)
+            assert(!g);
+    }
+    {
+        // pipeline of shared tasks passing data to each other
+        std::vector<std::string> y;
+        auto pipeline = callcc
+            (shared_stack, [](continuation<int()> input,
+                              continuation<void(double)> output) {
+                for (auto x: input)
+                    output(x*2);
+                return input;
+            }, callcc
+             (shared_stack, [](continuation<double()> input,
+                               std::vector<std::string>& y) {
+                 for (auto x: input)
+                     y.push_back(std::to_string(int(x)));
+                 return input;
+             }, std::ref(y)));
+        std::vector<int> x = { 1, 2, 3 };
+        std::copy(x.begin(), x.end(), begin(pipeline));
+        std::vector<std::string> expected = { "2", "4", "6" };
+        assert(y == expected);
+    }
+    {
+        // shared and normal continuations interleaved
+        auto normal = callcc([](continuation<void(int)> c) {
+                for (int i = 0; i < 3; ++i) c(i);
+                return c;
+            });
+        auto shared = callcc(shared_stack, [&](continuation<void(int)> c) {
+                for (auto x : normal)
+                    c(x + 10);
+                return c;
+            });
+        int j = 10;
+        for (; shared; shared())
+            assert(shared.get() == j++);
+        assert(j == 13);
+    }
+    {
+        // destroying parked shared continuations unwinds them
+        int destroyed = 0;
+        struct count { int& n; ~count() { n++; } };
+        {
+            auto a = callcc(shared_stack, [&](continuation<void()> c) {
+                    count _ {destroyed};
+                    c();
+                    return c;
+                });
+            auto b = callcc(shared_stack, [&](continuation<void()> c) {
+                    count _ {destroyed};
+                    deep(10);
+                    c();
+                    return c;
+                });
+        }
+        assert(destroyed == 2);
+    }
+    {
+        // exceptions still propagate through escape continuations
+        bool caught = false;
+        try {
+            auto c = callcc(shared_stack, [](continuation<void()> c) {
+                    c();
+                    with_escape_continuation([] { throw 10; }, c);
+                    return c;
+                });
+            c();
+        } catch(int x) {
+            assert(x == 10);
+            caught = true;
+        }
+        assert(caught);
+    }
+}
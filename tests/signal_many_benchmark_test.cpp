@@ -0,0 +1,99 @@
+#include "future.hpp"
+#include "fd_waiter.hpp"
+#include "task.hpp"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace gpd;
+
+typedef std::chrono::steady_clock clock_type;
+
+double us(clock_type::duration d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+const std::size_t completions = 1000;
+const int rounds = 20;
+
+void complete(std::vector<promise<int> >& ps, bool batched) {
+    if (batched) {
+        std::vector<int> values(ps.size(), 1);
+        set_values(ps.begin(), ps.end(), values.begin());
+    } else
+        for (auto& p : ps)
+            p.set_value(1);
+}
+
+// 1k completions into 'waiters' threads, each running wait_all on its
+// share with an fd_waiter.
+void threads(std::size_t waiters, bool batched) {
+    clock_type::duration total {};
+    for (int r = 0; r < rounds; ++r) {
+        std::vector<promise<int> > ps(completions);
+        std::vector<std::vector<future<int> > > fs(waiters);
+        for (std::size_t i = 0; i < ps.size(); ++i)
+            fs[i % waiters].push_back(ps[i].get_future());
+        std::atomic<std::size_t> started = { 0 };
+        std::vector<std::thread> ts;
+        for (auto& f : fs)
+            ts.emplace_back([&f, &started] {
+                    fd_waiter w;
+                    started++;
+                    wait_all(w, f);
+                });
+        while (started != waiters)
+            std::this_thread::yield();
+        auto t0 = clock_type::now();
+        complete(ps, batched);
+        total += clock_type::now() - t0;
+        for (auto& t : ts)
+            t.join();
+    }
+    std::cout << (batched ? "set_values" : "set_value loop") << ", "
+              << completions << " completions into " << waiters
+              << " fd_waiter threads: " << us(total) / rounds << " us\n";
+}
+
+// 1k completions, one per task, into tasks parked on 'n' schedulers.
+void tasks(std::vector<scheduler*>& scheds, bool batched) {
+    clock_type::duration total {};
+    for (int r = 0; r < rounds; ++r) {
+        std::vector<promise<int> > ps(completions);
+        std::vector<future<int> > results;
+        std::atomic<std::size_t> waiting = { 0 };
+        for (std::size_t i = 0; i < ps.size(); ++i)
+            results.push_back(
+                async(*scheds[i % scheds.size()],
+                      [f = ps[i].get_future(), &waiting] () mutable {
+                          waiting++;
+                          gpd::wait(pool, f);
+                          return f.get();
+                      }));
+        while (waiting != completions)
+            std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        auto t0 = clock_type::now();
+        complete(ps, batched);
+        futex_waiter w;
+        wait_all(w, results);
+        total += clock_type::now() - t0;
+    }
+    std::cout << (batched ? "set_values" : "set_value loop") << ", "
+              << completions << " completions into tasks on " << scheds.size()
+              << " schedulers (until all resumed): " << us(total) / rounds << " us\n";
+}
+
+int main() {
+    for (std::size_t waiters : { 1, 4 })
+        for (bool batched : { false, true })
+            threads(waiters, batched);
+
+    std::vector<scheduler*> scheds;
+    for (int i = 0; i < 4; ++i)
+        scheds.push_back(start_background_scheduler().get());
+    for (bool batched : { false, true })
+        tasks(scheds, batched);
+}
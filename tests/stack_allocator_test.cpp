@@ -0,0 +1,234 @@
+#include "continuation.hpp"
+#include "stack_allocator.hpp"
+#include "task.hpp"
+#include <chrono>
+#include <cassert>
+#include <thread>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Recurse until the stack overflows; the bound, which the compiler
+// cannot see through, is never reached.
+volatile unsigned long recurse_limit = ~0ul;
+
+int __attribute__((noinline)) recurse(volatile char * p, unsigned long depth = 0) {
+    volatile char buf[1024];
+    buf[0] = *p;
+    if (depth == recurse_limit)
+        return buf[0];
+    return recurse(buf, depth + 1) + buf[0];
+}
+
+// async on a registered stack, so that the scheduler can release it.
+template<class Alloc, class F>
+gpd::future<int> async_registered(gpd::scheduler& target, F f) {
+    gpd::details::async_task<F> run { target, std::move(f), {} };
+    auto future = run.promise.get_future();
+    gpd::callcc(std::allocator_arg, Alloc(), std::move(run));
+    return future;
+}
+
+int main() {
+    using namespace gpd;
+    typedef caching_stack_allocator<static_stack_allocator, 2, 2> cache_alloc;
+    static const size_t size = 64*1024;
+    {
+        cache_alloc a;
+        void * p = a.allocate(size);
+        a.deallocate(p);
+        assert(cache_alloc::local_count() == 1);
+        void * q = a.allocate(size);
+        assert(p == q);
+        assert(cache_alloc::local_count() == 0);
+        a.deallocate(q);
+    }
+    {
+        // different sizes are never mixed
+        cache_alloc a;
+        void * p = a.allocate(2*size);
+        assert(cache_alloc::local_count() == 1);
+        a.deallocate(p);
+        assert(cache_alloc::local_count() == 2);
+    }
+    {
+        // overflow to the global pool, then to the base allocator
+        cache_alloc a[6];
+        void * p[6];
+        for (int i = 0; i < 6; ++i) p[i] = a[i].allocate(size);
+        for (int i = 0; i < 6; ++i) a[i].deallocate(p[i]);
+        assert(cache_alloc::local_count() == 2);
+        assert(cache_alloc::global_count() == 2);
+        std::thread([] {
+                cache_alloc a;
+                a.deallocate(a.allocate(size)); // from global pool
+                assert(cache_alloc::global_count() == 1);
+                assert(cache_alloc::local_count() == 1);
+            }).join();
+        // exiting thread returns its stacks to the global pool
+        assert(cache_alloc::global_count() == 2);
+        assert(cache_alloc::trim() == 4);
+        assert(cache_alloc::local_count() == 0);
+        assert(cache_alloc::global_count() == 0);
+    }
+    {
+        void * sp = 0;
+        for (int i = 0; i < 10; ++i) {
+            auto c = details::create_continuation<void*()>
+                ([](continuation<void(void*)> c) {
+                    int x;
+                    c(&x);
+                    return c;
+                }, cache_alloc(), size);
+            assert(sp == 0 || c.get() == sp);
+            sp = c.get();
+            c();
+        }
+        assert(cache_alloc::local_count() == 1);
+        cache_alloc::trim();
+    }
+    {
+        typedef sized_stack_allocator<mmap_stack_allocator<> > mmap_alloc;
+        mmap_alloc a;
+        char * p = static_cast<char*>(a.allocate(size));
+        p[0] = p[size-1] = 1;
+        a.deallocate(p);
+
+        auto c = details::create_continuation<int()>
+            ([](continuation<void(int)> c) {
+                c(42);
+                return c;
+            }, mmap_alloc(), size);
+        assert(c.get() == 42);
+        c();
+    }
+    {
+        // overflowing an mmap stack must fault on the guard page
+        typedef sized_stack_allocator<mmap_stack_allocator<true> > mmap_alloc;
+        pid_t pid = ::fork();
+        assert(pid != -1);
+        if (pid == 0) {
+            ::alarm(10);
+            auto c = details::create_continuation<int()>
+                ([](continuation<void(int)> c) {
+                    volatile char x = 0;
+                    c(recurse(&x));
+                    return c;
+                }, mmap_alloc(), size);
+            ::_exit(0);
+        }
+        int status;
+        ::waitpid(pid, &status, 0);
+        assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+    }
+    {
+        // release the pages of a parked stack below its stack pointer
+        typedef registered_stack_allocator<
+            sized_stack_allocator<mmap_stack_allocator<> > > reg_alloc;
+        static const size_t big = 4*1024*1024;
+        auto c = details::create_continuation<void()>
+            ([](continuation<void()> c) {
+                std::vector<char> dummy; // keep a non trivial frame
+                auto deep = [&](char * p) {
+                    volatile char buf[1024*1024];
+                    for (size_t i = 0; i < sizeof(buf); i += 4096)
+                        buf[i] = *p;
+                };
+                char x = 0;
+                deep(&x);
+                c();
+                return c;
+            }, reg_alloc(), big);
+        assert(c);
+        size_t before = stack_resident(c);
+        assert(before >= 1024*1024);
+        auto stats = release_stack(c);
+        assert(stats.resident_before == before);
+        assert(stats.resident_after < 64*1024);
+        assert(stack_resident(c) == stats.resident_after);
+        c();
+    }
+    {
+        // high water mark of instrumented stacks, by tag
+        typedef instrumented_stack_allocator<
+            sized_stack_allocator<mmap_stack_allocator<> > > usage_alloc;
+        auto touch = [](size_t n) {
+            std::vector<char> dummy;
+            auto deep = [&](char * p) {
+                volatile char buf[128*1024];
+                // escape, so that the frame is really allocated, and
+                // reach n bytes below its top whatever its overhead
+                asm volatile ("" :: "r"(buf) : "memory");
+                for (size_t i = 512; i <= n; i += 512)
+                    buf[sizeof(buf) - i] = *p;
+            };
+            char x = 0;
+            deep(&x);
+        };
+        stack_usage_reset();
+        for (int i = 0; i < 2; ++i) {
+            auto c = callcc(std::allocator_arg, usage_alloc("deep"),
+                            [&](continuation<void()> c) {
+                                touch(100*1024);
+                                c();
+                                return c;
+                            });
+            assert(stack_high_water(c) >= 100*1024);
+            c();
+        }
+        auto c = callcc(std::allocator_arg, usage_alloc("shallow"),
+                        [&](continuation<void()> c) {
+                            return c;
+                        });
+        auto report = stack_usage_report();
+        assert(report["deep"].samples == 2);
+        assert(report["deep"].max_used >= 100*1024);
+        assert(report["deep"].max_used < 256*1024);
+        assert(report["deep"].percentile(1) >= report["deep"].max_used);
+        assert(report["shallow"].samples == 1);
+        assert(report["shallow"].max_used < 16*1024);
+        assert(report["shallow"].saturated == 0);
+    }
+
+    {
+        // the scheduler idle path releases the stacks it parked, and
+        // only those
+        using namespace std::chrono;
+        typedef registered_stack_allocator<
+            sized_stack_allocator<mmap_stack_allocator<> > > reg_alloc;
+        auto& sched = *start_background_scheduler().get();
+        auto& other = *start_background_scheduler().get();
+        set_stack_release_policy(sched, milliseconds(10));
+        set_stack_release_policy(other, milliseconds(10));
+        promise<int> p;
+        auto f = p.get_future();
+        auto parked = async_registered<reg_alloc>(sched, [&f] {
+                auto deep = [](char * p) {
+                    volatile char buf[256*1024];
+                    for (size_t i = 0; i < sizeof(buf); i += 4096)
+                        buf[i] = *p;
+                };
+                char x = 0;
+                deep(&x);
+                gpd::wait(pool, f);
+                return f.get();
+            });
+        auto nudge = [](scheduler& s) {
+            // leave the scheduler idle again
+            async(s, [] { return 0; }).get();
+            std::this_thread::sleep_for(milliseconds(5));
+        };
+        // parked for long enough, but not by 'other'
+        std::this_thread::sleep_for(milliseconds(20));
+        nudge(other);
+        assert(stack_release_totals(other).resident_before == 0);
+        for (int i = 0; i < 400 && !stack_release_totals(sched).resident_before; ++i)
+            nudge(sched);
+        auto totals = stack_release_totals(sched);
+        assert(totals.resident_before >= 256*1024);
+        assert(totals.resident_after < totals.resident_before);
+        p.set_value(7);
+        assert(parked.get() == 7);
+    }
+
+}
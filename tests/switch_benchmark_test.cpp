@@ -0,0 +1,73 @@
+#include "continuation.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace gpd;
+
+struct payload {
+    long data[32];
+};
+
+// Time 'count' switch round trips of a generator of T, sent by the
+// generator as 'sent' (T, or a reference to T).
+template<class T, class Sent = T>
+void generator(const char * name, int count) {
+    auto c = callcc([count](continuation<void(Sent)> c) {
+            T x {};
+            for (int j = 0; j < count; ++j) {
+                reinterpret_cast<char&>(x) = j;
+                c(x);
+            }
+            return c;
+        });
+    auto start = std::chrono::steady_clock::now();
+    long sum = 0;
+    for (; c; c()) {
+        T x = c.get();
+        sum += reinterpret_cast<char&>(x);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    assert(sum != -1);
+    std::cout << name << ": "
+              << std::chrono::duration<double, std::nano>(elapsed).count()
+        / (2. * count)
+              << " ns/switch\n";
+}
+
+// Switch latency: ping-pong between two continuations, with some
+// values live across each switch.
+int main()
+{
+#ifdef GPD_INLINE_SWITCH
+    std::string backend = "inline asm";
+#else
+    std::string backend = "out of line";
+#endif
+    const int count = 10000000;
+    for (int i = 0; i < 4; ++i)
+    {
+        auto c = callcc([](continuation<void(int)> c) {
+                for (int j = 0; j < count; ++j)
+                    c(j);
+                return c;
+            });
+        auto start = std::chrono::steady_clock::now();
+        long sum = 0;
+        for (; c; c())
+            sum += c.get();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        assert(sum == long(count) * (count - 1) / 2);
+        std::cout << backend << ": "
+                  << std::chrono::duration<double, std::nano>(elapsed).count()
+            / (2. * count)
+                  << " ns/switch\n";
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        generator<int>((backend + ", int").c_str(), count);
+        generator<payload>((backend + ", 256 bytes by value").c_str(), count);
+        generator<payload, const payload&>
+            ((backend + ", 256 bytes by reference").c_str(), count);
+    }
+}
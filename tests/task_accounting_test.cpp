@@ -0,0 +1,95 @@
+#define GPD_TASK_ACCOUNTING
+#include "task_accounting.hpp"
+#include "continuation.hpp"
+#include "fiber_pool.hpp"
+#include "task.hpp"
+#include <cassert>
+#include <iostream>
+#include <thread>
+
+using namespace gpd;
+
+void spin(std::uint64_t cycles) {
+    auto end = details::account_clock() + cycles;
+    while (details::account_clock() < end) {}
+}
+
+int main() {
+    {
+        // resumes and cycles of the running context
+        task_stats inside;
+        auto c = callcc([&](continuation<void()> c) {
+                set_task_label("worker");
+                for (int i = 0; i < 3; ++i) {
+                    spin(1000000);
+                    c();
+                }
+                inside = current_task_stats();
+                return c;
+            });
+        while (c) c();
+        assert(inside.resumes == 4);
+        assert(inside.migrations == 0);
+        assert(inside.cycles >= 3000000);
+    }
+    {
+        // resuming on another thread is a migration
+        task_stats inside;
+        auto c = callcc([&](continuation<void()> c) {
+                c();
+                c();
+                inside = current_task_stats();
+                return c;
+            });
+        std::thread([&] { c(); }).join();
+        c();
+        assert(!c);
+        assert(inside.resumes == 3);
+        assert(inside.migrations == 2);
+    }
+    {
+        // yielding to another scheduler is a migration, for stackful
+        // and stackless tasks
+        auto& s1 = *start_background_scheduler().get();
+        auto& s2 = *start_background_scheduler().get();
+        auto migrate = [&] {
+            auto before = current_task_stats();
+            yield(s2);
+            auto after = current_task_stats();
+            return after.resumes == before.resumes + 1 &&
+                after.migrations == before.migrations + 1;
+        };
+        assert(async(s1, migrate).get());
+        assert(async(s1, stackless, migrate).get());
+    }
+    {
+        // top consumers: live contexts and finished totals by label
+        reset_task_totals();
+        auto busy = callcc([](continuation<void()> c) {
+                set_task_label("busy");
+                spin(5000000);
+                c();
+                return c;
+            });
+        auto idle = callcc([](continuation<void()> c) {
+                set_task_label("idle");
+                c();
+                return c;
+            });
+        fiber_pool<> fibers;
+        for (int i = 0; i < 2; ++i)
+            fibers.callcc([](continuation<void()> c) {
+                    set_task_label("pooled");
+                    spin(1000000);
+                    return c;
+                });
+        auto top = top_tasks(2);
+        assert(top.size() == 2);
+        assert(top[0].label == "busy" && top[0].live);
+        assert(top[1].label == "pooled" && !top[1].live);
+        assert(top[1].stats.resumes == 2);
+        dump_top_tasks(std::cout);
+        busy();
+        idle();
+    }
+}
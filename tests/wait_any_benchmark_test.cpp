@@ -0,0 +1,141 @@
+#include "futex_waiter.hpp"
+#include "futexv_waiter.hpp"
+#include "wait_set.hpp"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+using namespace gpd;
+
+typedef std::chrono::steady_clock clock_type;
+
+double ns(clock_type::duration d) {
+    return std::chrono::duration<double, std::nano>(d).count();
+}
+
+// wait_any on 'n' events, one of which is already signaled: the cost
+// of registering and dismissing the waits.
+template<class WaitStrategy>
+void ready(const char * name, std::size_t n) {
+    const std::size_t rounds = std::max<std::size_t>(100, 1000000 / n);
+    std::unique_ptr<event[]> events(new event[n]);
+    std::vector<event*> ptrs;
+    for (std::size_t i = 0; i < n; ++i)
+        ptrs.push_back(&events[i]);
+    ptrs.back()->signal();
+
+    WaitStrategy w;
+    auto t0 = clock_type::now();
+    for (std::size_t r = 0; r < rounds; ++r)
+        wait_any(w, ptrs);
+    auto t1 = clock_type::now();
+    std::cout << name << ", " << n << " events, one ready: "
+              << ns(t1 - t0) / rounds << " ns\n";
+}
+
+// wait_any on 'n' events, one of which another thread signals.
+template<class WaitStrategy>
+void woken(const char * name, std::size_t n) {
+    const std::size_t rounds = 20000;
+    std::unique_ptr<event[]> events(new event[n]);
+    std::vector<event*> ptrs;
+    for (std::size_t i = 0; i < n; ++i)
+        ptrs.push_back(&events[i]);
+
+    std::atomic<std::size_t> started = { 0 };
+    std::atomic<std::size_t> done = { 0 };
+    std::thread signaller([&] {
+            for (std::size_t r = 1; r <= rounds; ++r) {
+                while (started.load(std::memory_order_acquire) != r)
+                    std::this_thread::yield();
+                ptrs[r % n]->signal();
+                done.store(r, std::memory_order_release);
+            }
+        });
+
+    WaitStrategy w;
+    clock_type::duration wait_time {};
+    for (std::size_t r = 1; r <= rounds; ++r) {
+        started.store(r, std::memory_order_release);
+        auto t0 = clock_type::now();
+        wait_any(w, ptrs);
+        wait_time += clock_type::now() - t0;
+        while (done.load(std::memory_order_acquire) != r)
+            std::this_thread::yield();
+        auto e = ptrs[r % n];
+        e->~event();
+        new (e) event();
+    }
+    signaller.join();
+    std::cout << name << ", " << n << " events, woken: "
+              << ns(wait_time) / rounds << " ns\n";
+}
+
+// As 'woken', with the events members of a persistent wait_set: only
+// the signaled one is re-armed each round.
+template<class WaitStrategy>
+void woken_set(const char * name, std::size_t n) {
+    const std::size_t rounds = 20000;
+    std::unique_ptr<event[]> events(new event[n]);
+    std::vector<event*> ptrs;
+    for (std::size_t i = 0; i < n; ++i)
+        ptrs.push_back(&events[i]);
+    wait_set set;
+    for (auto& p : ptrs)
+        set.add(p);
+
+    std::atomic<std::size_t> started = { 0 };
+    std::atomic<std::size_t> done = { 0 };
+    std::thread signaller([&] {
+            for (std::size_t r = 1; r <= rounds; ++r) {
+                while (started.load(std::memory_order_acquire) != r)
+                    std::this_thread::yield();
+                ptrs[r % n]->signal();
+                done.store(r, std::memory_order_release);
+            }
+        });
+
+    WaitStrategy w;
+    std::vector<wait_set::key_type> ready;
+    clock_type::duration wait_time {};
+    for (std::size_t r = 1; r <= rounds; ++r) {
+        started.store(r, std::memory_order_release);
+        auto t0 = clock_type::now();
+        wait(w, set);
+        ready.clear();
+        set.take_ready(std::back_inserter(ready));
+        wait_time += clock_type::now() - t0;
+        while (done.load(std::memory_order_acquire) != r)
+            std::this_thread::yield();
+        for (auto k : ready) {
+            auto e = ptrs[k];
+            e->~event();
+            new (e) event();
+            set.rearm(k);
+        }
+    }
+    signaller.join();
+    std::cout << name << " wait_set, " << n << " events, woken: "
+              << ns(wait_time) / rounds << " ns\n";
+}
+
+template<class WaitStrategy>
+void run(const char * name) {
+    for (std::size_t n : { 1, 8, 32, 128 })
+        ready<WaitStrategy>(name, n);
+    for (std::size_t n : { 1, 8, 32, 128 })
+        woken<WaitStrategy>(name, n);
+}
+
+int main() {
+    if (!futex_waitv_available())
+        std::cout << "futex_waitv not available, futexv_waiter falls back to futex_waiter\n";
+    run<futex_waiter>("futex_waiter (latch)");
+    run<futexv_waiter>("futexv_waiter");
+    for (std::size_t n : { 1, 8, 32, 128 })
+        woken_set<futex_waiter>("futex_waiter", n);
+}
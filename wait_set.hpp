@@ -0,0 +1,188 @@
+#ifndef GPD_WAIT_SET_HPP
+#define GPD_WAIT_SET_HPP
+#include "event.hpp"
+#include <atomic>
+#include <cassert>
+#include <deque>
+#include <new>
+#include <thread>
+#include <vector>
+namespace gpd {
+
+/**
+ * Persistent set of Waitables for repeated wait_any style selection.
+ *
+ * Each member is registered with its event once, by 'add' (or
+ * 'rearm'), and stays registered across waits; a signaled member is
+ * pushed on a lock-free ready list, and the set itself is a Waitable
+ * whose event is signaled when the list becomes non empty. A round
+ * of
+ *
+ *     wait(how, set);
+ *     set.take_ready(out);
+ *
+ * registers a single event and costs O(fired), instead of the O(n)
+ * wait_many/dismiss_wait_many of wait_any. Any wait strategy and any
+ * wait entry point (timed or not, scheduler included) can be used on
+ * the set, also alongside other Waitables.
+ *
+ * Members are one shot, as their events: a member delivered by
+ * take_ready is not waited again until 'rearm'ed, typically after
+ * its Waitable has been replaced by a fresh one in place.
+ *
+ * Signaling the members is thread safe; everything else must be
+ * called by the single owner of the set. The set does not own the
+ * Waitables, which must outlive their membership.
+ */
+class wait_set {
+public:
+    using key_type = std::size_t;
+
+    wait_set() {}
+    wait_set(const wait_set&) = delete;
+    void operator=(const wait_set&) = delete;
+
+    /// Dismiss every member; waits for members being signaled
+    /// concurrently to get to the ready list. The Waitables of removed
+    /// members, which may be gone, are not touched.
+    ~wait_set() {
+        std::size_t pending = 0;
+        for (auto& e : entries)
+            if (e.armed && (e.removed || !e.get(e.waitable)->dismiss_wait(&e)))
+                ++pending;
+            else
+                e.armed = false;
+        while (pending) {
+            if (!ready_event.is_signaled()) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (auto e = take_list(); e; e = e->next) {
+                assert(e->armed);
+                --pending;
+            }
+        }
+    }
+
+    /// Add 'w' to the set and wait for it; return its key. If 'w' is
+    /// already ready, it is immediately on the ready list.
+    template<class Waitable>
+    key_type add(Waitable& w) {
+        key_type key;
+        if (free_keys.empty()) {
+            key = entries.size();
+            entries.emplace_back();
+        } else {
+            key = free_keys.back();
+            free_keys.pop_back();
+        }
+        auto& e = entries[key];
+        e.set = this;
+        e.key = key;
+        e.waitable = &w;
+        e.get = [](void * p) -> event* {
+            return get_event(*static_cast<Waitable*>(p));
+        };
+        e.removed = false;
+        arm(e);
+        return key;
+    }
+
+    /// Wait again for the member 'key', which must have been delivered
+    /// by take_ready, e.g. after replacing its Waitable in place.
+    void rearm(key_type key) {
+        auto& e = entries[key];
+        assert(!e.armed && !e.removed);
+        arm(e);
+    }
+
+    /// Remove the member 'key'; its Waitable is no longer touched by
+    /// the set and its key may be reused.
+    void remove(key_type key) {
+        auto& e = entries[key];
+        assert(!e.removed);
+        e.removed = true;
+        // a member signaled meanwhile is released by take_ready
+        if (!e.armed || e.get(e.waitable)->dismiss_wait(&e)) {
+            e.armed = false;
+            free_keys.push_back(key);
+        }
+    }
+
+    /// Whether take_ready has any member to deliver.
+    bool ready() const { return ready_event.is_signaled(); }
+
+    /// Write the keys of the members signaled since the last call, in
+    /// signaling order, to 'out'. Never blocks; wait on the set first
+    /// to block until there is any.
+    template<class OutIter>
+    OutIter take_ready(OutIter out) {
+        if (!ready())
+            return out;
+        entry * fired = nullptr;
+        for (auto e = take_list(); e; ) {
+            auto next = e->next;
+            e->next = fired;
+            fired = e;
+            e = next;
+        }
+        for (auto e = fired; e; e = e->next) {
+            e->armed = false;
+            if (e->removed)
+                free_keys.push_back(e->key);
+            else
+                *out++ = e->key;
+        }
+        return out;
+    }
+
+    friend event * get_event(wait_set& s) { return &s.ready_event; }
+
+private:
+    struct entry : direct_waiter<entry> {
+        wait_set * set;
+        key_type key;
+        void * waitable;
+        event * (*get)(void *);
+        entry * next;
+        bool armed = false;
+        bool removed = false;
+
+        void on_signal(event_base *) {
+            set->push(this);
+        }
+    };
+
+    void arm(entry& e) {
+        e.armed = true;
+        e.get(e.waitable)->wait(&e);
+    }
+
+    // The producer turning the list non empty signals 'ready_event'
+    // and touches nothing after that.
+    void push(entry * e) {
+        auto h = head.load(std::memory_order_relaxed);
+        do {
+            e->next = h;
+        } while (!head.compare_exchange_weak(h, e, std::memory_order_release,
+                                             std::memory_order_relaxed));
+        if (!h)
+            ready_event.signal();
+    }
+
+    // Pre: ready_event is signaled, so no producer touches it again
+    // until the list is emptied; reset it, then take the list.
+    entry * take_list() {
+        ready_event.~event();
+        new (&ready_event) event;
+        return head.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    event ready_event;
+    std::atomic<entry*> head = { nullptr };
+    std::deque<entry> entries; // stable addresses
+    std::vector<key_type> free_keys;
+};
+
+}
+#endif